@@ -0,0 +1,358 @@
+/// @file
+/// @brief  xtl type-erasure benchmark - delegate vs std::function vs any vs std::any
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+///
+/// Measures construct, move, invoke and destroy of type-erased callables/values
+/// whose captured state is on both sides of the SOO threshold, and reports ns/op and allocations/op.
+/// Also measures event_callback::raise from one and from multiple threads.
+/// Build with optimization (e.g. Release) to get meaningful numbers.
+
+#include <xtl/xtl_any.h>
+#include <xtl/xtl_delegate.h>
+#include <xtl/xtl_event_callback.h>
+#include <xtl/xtl_function_ref.h>
+#include <xtl/xtl_timestamp.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <any>
+#include <functional>
+#include <new>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <malloc.h>
+#endif
+
+namespace
+{
+    // allocation counter (relaxed: "raise mt" allocates from multiple threads)
+    std::atomic<size_t> allocation_count{0};
+
+    template <class T>
+    inline void do_not_optimize(T& value)
+    {
+#if defined(_MSC_VER)
+        static_cast<void>(static_cast<volatile char&>(reinterpret_cast<char&>(value)));
+        _ReadWriteBarrier();
+#else
+        asm volatile("" : : "r,m"(value) : "memory");
+#endif
+    }
+
+    struct result
+    {
+        double ns_per_op;
+        double allocations_per_op;
+    };
+
+    /// Runs `body(iterations)` and returns the cost per operation.
+    template <class F>
+    result measure(size_t iterations, size_t operations_per_iteration, F&& body)
+    {
+        body(iterations / 16 + 1); // warm up
+
+        const size_t allocations = allocation_count.load(std::memory_order_relaxed);
+        const xtl::timestamp begin = xtl::timestamp::now();
+        body(iterations);
+        const xtl::timestamp end = xtl::timestamp::now();
+
+        const auto operations = static_cast<double>(iterations * operations_per_iteration);
+        return result{
+            static_cast<double>(end.tick - begin.tick) * 1e9 / static_cast<double>(xtl::timestamp::ticks_per_second) / operations,
+            static_cast<double>(allocation_count.load(std::memory_order_relaxed) - allocations) / operations,
+        };
+    }
+
+    /// Runs `prepare(objects)` untimed and `body(objects)` timed, chunk by chunk.
+    template <class T, class P, class F>
+    result measure_chunked(size_t iterations, P&& prepare, F&& body)
+    {
+        constexpr size_t chunk_size = 4096;
+        std::vector<std::optional<T>> objects(chunk_size);
+
+        size_t allocations = 0;
+        xtl::timestamp::value_type ticks = 0;
+        for (size_t done = 0; done < iterations; done += chunk_size)
+        {
+            prepare(objects);
+
+            const size_t a = allocation_count.load(std::memory_order_relaxed);
+            const xtl::timestamp begin = xtl::timestamp::now();
+            body(objects);
+            const xtl::timestamp end = xtl::timestamp::now();
+            allocations += allocation_count.load(std::memory_order_relaxed) - a;
+            ticks += end.tick - begin.tick;
+
+            for (auto& o : objects) o.reset();
+        }
+
+        const auto operations = static_cast<double>((iterations + chunk_size - 1) / chunk_size * chunk_size);
+        return result{
+            static_cast<double>(ticks) * 1e9 / static_cast<double>(xtl::timestamp::ticks_per_second) / operations,
+            static_cast<double>(allocations) / operations,
+        };
+    }
+
+    void report(const char* subject, const char* operation, size_t captured_size, result r)
+    {
+        std::printf("%-20s %-10s %6zu %10.2f ns/op %8.2f allocs/op\n", subject, operation, captured_size, r.ns_per_op, r.allocations_per_op);
+    }
+
+    /// callable with N bytes of captured state
+    template <size_t N>
+    struct payload
+    {
+        std::array<unsigned char, N> state{};
+        int operator()(int x) const { return x + state[0]; }
+    };
+
+    /// type-erasure adapters
+    struct xtl_delegate
+    {
+        static constexpr const char* name = "xtl::delegate";
+        using type = xtl::delegate<int(int)>;
+        template <class P> static type make(const P& p) { return type(p); }
+        static int invoke(type& f, int x) { return f(x); }
+    };
+
+    struct std_function
+    {
+        static constexpr const char* name = "std::function";
+        using type = std::function<int(int)>;
+        template <class P> static type make(const P& p) { return type(p); }
+        static int invoke(type& f, int x) { return f(x); }
+    };
+
+    template <size_t N>
+    struct xtl_any
+    {
+        static constexpr const char* name = "xtl::any";
+        using type = xtl::any;
+        template <class P> static type make(const P& p) { return type(p); }
+        static int invoke(type& f, int x) { return (*f.get_if<payload<N>>())(x); }
+    };
+
+    template <size_t N>
+    struct std_any
+    {
+        static constexpr const char* name = "std::any";
+        using type = std::any;
+        template <class P> static type make(const P& p) { return type(p); }
+        static int invoke(type& f, int x) { return (*std::any_cast<payload<N>>(&f))(x); }
+    };
+
+    template <class E, size_t N>
+    void run(size_t iterations)
+    {
+        using T = typename E::type;
+        const payload<N> p{};
+
+        report(E::name, "construct", N, measure_chunked<T>(
+                   iterations,
+                   [](auto&) { },
+                   [&](auto& objects) { for (auto& o : objects) o.emplace(E::make(p)); }));
+
+        report(E::name, "move", N, measure(iterations, 2, [&](size_t n)
+        {
+            T a = E::make(p);
+            T b{};
+            for (size_t i = 0; i < n; i++)
+            {
+                b = std::move(a);
+                do_not_optimize(b);
+                a = std::move(b);
+                do_not_optimize(a);
+            }
+        }));
+
+        report(E::name, "invoke", N, measure(iterations, 1, [&](size_t n)
+        {
+            T a = E::make(p);
+            int sum = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                do_not_optimize(a);
+                sum += E::invoke(a, static_cast<int>(i));
+            }
+            do_not_optimize(sum);
+        }));
+
+        report(E::name, "destroy", N, measure_chunked<T>(
+                   iterations,
+                   [&](auto& objects) { for (auto& o : objects) o.emplace(E::make(p)); },
+                   [](auto& objects) { for (auto& o : objects) o.reset(); }));
+    }
+
+    template <size_t N>
+    void run_all(size_t iterations)
+    {
+        run<xtl_delegate, N>(iterations);
+        run<std_function, N>(iterations);
+        run<xtl_any<N>, N>(iterations);
+        run<std_any<N>, N>(iterations);
+        std::printf("\n");
+    }
+
+    int add_one(int x) { return x + 1; }
+
+    // the callee takes the callback as parameter, invoked during the call only.
+    template <class F>
+#if defined(_MSC_VER)
+    __declspec(noinline)
+#else
+    __attribute__((noinline))
+#endif
+    int call_with(F&& f, size_t n)
+    {
+        int sum = 0;
+        for (size_t i = 0; i < n; i++) sum += f(static_cast<int>(i));
+        return sum;
+    }
+
+    void run_callback_parameters(size_t iterations)
+    {
+        const payload<16> p{};
+
+        report("function pointer", "call", sizeof(void*), measure(iterations, 1, [&](size_t n)
+        {
+            int (*f)(int) = add_one;
+            do_not_optimize(f);
+            int sum = call_with<int(*)(int)>(std::move(f), n);
+            do_not_optimize(sum);
+        }));
+
+        report("xtl::function_ref", "call", sizeof(p), measure(iterations, 1, [&](size_t n)
+        {
+            xtl::function_ref<int(int)> f = p;
+            do_not_optimize(f);
+            int sum = call_with<xtl::function_ref<int(int)>>(std::move(f), n);
+            do_not_optimize(sum);
+        }));
+
+        report("xtl::delegate", "call", sizeof(p), measure(iterations, 1, [&](size_t n)
+        {
+            xtl::delegate<int(int)> f = p;
+            do_not_optimize(f);
+            int sum = call_with<xtl::delegate<int(int)>&>(f, n);
+            do_not_optimize(sum);
+        }));
+
+        report("std::function", "call", sizeof(p), measure(iterations, 1, [&](size_t n)
+        {
+            std::function<int(int)> f = p;
+            do_not_optimize(f);
+            int sum = call_with<std::function<int(int)>&>(f, n);
+            do_not_optimize(sum);
+        }));
+
+        // per-call construction of the callback parameter
+        report("xtl::function_ref", "pass", sizeof(p), measure(iterations, 1, [&](size_t n)
+        {
+            int sum = 0;
+            for (size_t i = 0; i < n; i++) sum += call_with<xtl::function_ref<int(int)>>(p, 1);
+            do_not_optimize(sum);
+        }));
+
+        report("xtl::delegate", "pass", sizeof(p), measure(iterations, 1, [&](size_t n)
+        {
+            int sum = 0;
+            for (size_t i = 0; i < n; i++) sum += call_with<xtl::delegate<int(int)>>(p, 1);
+            do_not_optimize(sum);
+        }));
+
+        report("std::function", "pass", sizeof(p), measure(iterations, 1, [&](size_t n)
+        {
+            int sum = 0;
+            for (size_t i = 0; i < n; i++) sum += call_with<std::function<int(int)>>(p, 1);
+            do_not_optimize(sum);
+        }));
+
+        std::printf("\n");
+    }
+
+    void run_event_callback(size_t iterations)
+    {
+        for (size_t subscribers : {1, 4})
+        {
+            xtl::event_callback<void(int)> event;
+            for (size_t i = 0; i < subscribers; i++)
+                event.subscribe([](int x) { do_not_optimize(x); });
+
+            report("xtl::event_callback", subscribers == 1 ? "raise x1" : "raise x4", sizeof(void*), measure(iterations, 1, [&](size_t n)
+            {
+                for (size_t i = 0; i < n; i++) event.raise(static_cast<int>(i));
+            }));
+        }
+
+        // concurrent raisers on the same event (wall time per raise, including the thread startup).
+        const size_t thread_count = std::max<size_t>(std::min<size_t>(std::thread::hardware_concurrency(), 4), 2);
+        xtl::event_callback<void(int)> event;
+        event.subscribe([](int x) { do_not_optimize(x); });
+
+        report("xtl::event_callback", "raise mt", thread_count, measure(iterations, 1, [&](size_t n)
+        {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < thread_count; t++)
+                threads.emplace_back([&event, n, thread_count] { for (size_t i = 0; i < n / thread_count; i++) event.raise(static_cast<int>(i)); });
+            for (auto& thread : threads) thread.join();
+        }));
+
+        std::printf("\n");
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// std::pmr::new_delete_resource may use aligned new
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    const auto a = static_cast<std::size_t>(alignment);
+#if defined(_MSC_VER)
+    if (void* p = _aligned_malloc(size ? size : 1, a)) return p;
+#else
+    if (void* p = std::aligned_alloc(a, (size + a - 1) / a * a + (size ? 0 : a))) return p;
+#endif
+    throw std::bad_alloc();
+}
+
+#if defined(_MSC_VER)
+void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { _aligned_free(p); }
+#else
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+
+int main(int argc, char* argv[])
+{
+    const size_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    std::printf("%-20s %-10s %6s %16s %18s\n", "subject", "operation", "bytes", "time", "allocations");
+    run_callback_parameters(iterations);
+    run_event_callback(iterations);
+    run_all<8>(iterations);
+    run_all<32>(iterations);
+    run_all<56>(iterations);  // fits in xtl::any
+    run_all<64>(iterations);  // fits in xtl::delegate
+    run_all<128>(iterations); // heap
+    run_all<256>(iterations); // heap
+    return 0;
+}
@@ -2,6 +2,9 @@
 
 #include <iostream>
 #include <memory>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 struct check : xtl::debug::copy_move_operation_debug_helper::movable<int>
 {
@@ -35,7 +38,7 @@ struct Test
         std::is_nothrow_move_constructible_v<std::remove_cv_t<std::remove_reference_t<F>>>&&
         std::is_invocable_r_v<R, F, P, A...>
     >* = nullptr>
-    static inline R F(P&& instance_pointer, F&& member_function, A&&... a)
+    static inline R invoke(P&& instance_pointer, F&& member_function, A&&... a)
     {
         return [instance_pointer = std::forward<P>(instance_pointer), member_function = std::forward<F>(member_function)](A... a)
         {
@@ -67,7 +70,7 @@ int main()
 
     {
         const check x{ 98 };
-        Test<void, int>::F(&x, &check::hello, 123);
+        Test<void, int>::invoke(&x, &check::hello, 123);
     }
 
     {
@@ -91,5 +94,53 @@ int main()
     x = zz;
     x(10);
 
+    {
+        // per-thread streams of a destroyed thread_buffered_ostream are dropped on the next miss.
+        {
+            xtl::thread_buffered_ostream a([](std::string_view line) { std::cout << line; });
+            a << "thread_buffered_ostream a" << std::endl;
+        }
+        xtl::thread_buffered_ostream b([](std::string_view line) { std::cout << line; });
+        b << "thread_buffered_ostream b" << std::endl;
+        std::cout << "thread_stream_count = " << xtl::thread_buffered_ostream::thread_stream_count() << std::endl;
+        if (xtl::thread_buffered_ostream::thread_stream_count() != 1) return 1;
+    }
+
+    {
+        // per-thread streams on other threads release the sink of the destroyed facade, and discard their partial lines.
+        auto token = std::make_shared<int>();
+        std::atomic<int> lines{};
+        std::atomic<int> lines_after_destroyed{};
+        std::atomic<bool> destroyed{};
+        auto log = std::make_unique<xtl::thread_buffered_ostream>([token, &lines, &lines_after_destroyed, &destroyed](std::string_view)
+        {
+            ++lines;
+            if (destroyed) ++lines_after_destroyed;
+        });
+
+        std::atomic<int> ready{};
+        std::atomic<bool> go{};
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 3; i++)
+        {
+            threads.emplace_back([&log, &ready, &go, i]
+            {
+                *log << "thread " << i << std::endl << "partial";
+                ++ready;
+                while (!go) std::this_thread::yield();
+            });
+        }
+
+        while (ready != 3) std::this_thread::yield();
+        log.reset();
+        destroyed = true;
+        const bool released = token.use_count() == 1; // while the threads still hold their streams
+        go = true;
+        for (auto& t : threads) t.join();
+
+        std::cout << "sink released = " << released << ", lines = " << lines << ", after destroyed = " << lines_after_destroyed << std::endl;
+        if (!released || lines != 3 || lines_after_destroyed != 0) return 1;
+    }
+
     //xtl::delegate_detail::deduction_test::delegate_type_deduce_test();
 }
@@ -8,6 +8,9 @@
 
 #include "./xtl_aligned_memory_block.h"
 #include "./xtl_any.h"
+#include "./xtl_async_callback_ostream.h"
+#include "./xtl_async_event_callback.h"
+#include "./xtl_binary_logger.h"
 #include "./xtl_concurrent_queue.h"
 #include "./xtl_copy_move_operation_debug_helper.h"
 #include "./xtl_delegate.h"
@@ -15,13 +18,18 @@
 #include "./xtl_enum_struct_bitwise_operators.h"
 #include "./xtl_event_callback.h"
 #include "./xtl_exception.h"
+#include "./xtl_fast_timestamp.h"
 #include "./xtl_filesystem.h"
 #include "./xtl_fixed_buffer_string.h"
 #include "./xtl_fixed_memory_stream.h"
+#include "./xtl_function_ref.h"
 #include "./xtl_functional.h"
+#include "./xtl_latency_histogram.h"
 #include "./xtl_lazy.h"
 #include "./xtl_manual_reset_event.h"
+#include "./xtl_memoized.h"
 #include "./xtl_mstream.h"
+#include "./xtl_multicast_delegate.h"
 #include "./xtl_ostream.h"
 #include "./xtl_rastream.h"
 #include "./xtl_single_thread.h"
@@ -32,5 +40,6 @@
 #include "./xtl_timestamp.h"
 #include "./xtl_type_indexed_map.h"
 #include "./xtl_type_indexed_pointer_map.h"
+#include "./xtl_type_key.h"
 #include "./xtl_value_or_error.h"
 #include "./xtl_worker_thread_pool.h"
@@ -10,12 +10,15 @@
 #include <array>
 #include <cassert>
 #include <memory>
+#include <memory_resource>
 #include <variant>
 #include <typeindex>
 #include <any>
 #include <stdexcept>
+#include <utility>
 
 #include "xtl_small_object_optimization.h"
+#include "xtl_type_key.h"
 
 namespace xtl
 {
@@ -59,7 +62,7 @@ namespace xtl
                 if (other.vtable_)
                 {
                     vtable_ = std::exchange(other.vtable_, nullptr);
-                    vtable_->move_constructor(this->memory_, std::move(other.memory_));
+                    soo::relocate(this->memory_, std::move(other.memory_), vtable_->move_constructor);
                 }
             }
 
@@ -80,6 +83,20 @@ namespace xtl
             this->emplace<T>(std::forward<Args>(args)...);
         }
 
+        // constructor from T&&, allocates from `resource` if T does not fit in the soo memory
+        template <class T, std::enable_if_t<!is_any<T> && is_fit<T>>* = nullptr>
+        any(std::allocator_arg_t, std::pmr::memory_resource* resource, T&& object)
+        {
+            this->emplace_on<std::decay_t<T>>(resource, std::forward<T>(object));
+        }
+
+        // in-place constructor from Args&&..., allocates from `resource` if T does not fit in the soo memory
+        template <class T, class... Args, std::enable_if_t<!is_any<T> && is_fit<T> && std::is_constructible_v<T, Args&&...>>* = nullptr>
+        any(std::allocator_arg_t, std::pmr::memory_resource* resource, std::in_place_type_t<T>, Args&&... args)
+        {
+            this->emplace_on<T>(resource, std::forward<Args>(args)...);
+        }
+
         // destructor
         ~any()
         {
@@ -89,9 +106,16 @@ namespace xtl
         // emplaces from Args&&...
         template <class T, class... Args, std::enable_if_t<!is_any<T> && is_fit<T> && std::is_constructible_v<T, Args&&...>>* = nullptr>
         std::decay_t<T>& emplace(Args&&... args)
+        {
+            return this->emplace_on<T>(std::pmr::get_default_resource(), std::forward<Args>(args)...);
+        }
+
+        // emplaces from Args&&..., allocates from `resource` if T does not fit in the soo memory
+        template <class T, class... Args, std::enable_if_t<!is_any<T> && is_fit<T> && std::is_constructible_v<T, Args&&...>>* = nullptr>
+        std::decay_t<T>& emplace_on(std::pmr::memory_resource* resource, Args&&... args)
         {
             this->reset();
-            auto& ref = soo::construct<T>(this->memory_, std::forward<Args>(args)...);
+            auto& ref = soo::construct_on<T>(this->memory_, resource, std::forward<Args>(args)...);
             this->vtable_ = soo::get_basic_vtable<T>();
             return ref;
         }
@@ -101,7 +125,7 @@ namespace xtl
         {
             if (this->vtable_)
             {
-                this->vtable_->destructor(this->memory_);
+                soo::destroy(this->memory_, this->vtable_->destructor);
                 this->vtable_ = nullptr;
             }
         }
@@ -119,6 +143,12 @@ namespace xtl
             return vtable_;
         }
 
+        [[nodiscard]] type_key key() const noexcept
+        {
+            return vtable_ ? vtable_->key : type_key{};
+        }
+
+#if !defined(XTL_NO_RTTI)
         [[nodiscard]] const std::type_info& type() const noexcept
         {
             return vtable_ ? vtable_->type : typeid(void);
@@ -128,11 +158,12 @@ namespace xtl
         {
             return std::type_index{type()};
         }
+#endif
 
         template <class T>
         [[nodiscard]] bool has() const noexcept
         {
-            return vtable_ && vtable_->type == typeid(T);
+            return vtable_ && vtable_->key == type_key_of<std::remove_cv_t<T>>;
         }
 
         template <class T>
@@ -153,8 +184,6 @@ namespace xtl
     template <class T, std::enable_if_t<std::is_constructible_v<T, const std::remove_cv_t<std::remove_reference_t<T>>&>> * = nullptr>
     [[nodiscard]] T any_cast(const any& a)
     {
-        std::any x;
-        std::any_cast<int>(std::move(x));
         if (auto p = a.get_if<std::remove_cv_t<std::remove_reference_t<T>>>()) return *p;
         else throw bad_any_cast();
     }
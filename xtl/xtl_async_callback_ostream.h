@@ -0,0 +1,344 @@
+/// @file
+/// @brief  xtl::async_callback_ostream - callback_ostream which calls the sink on a background writer thread
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <string>
+#include <string_view>
+#include <streambuf>
+#include <ostream>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+
+namespace xtl
+{
+    enum struct async_callback_ostream_if_full
+    {
+        block, ///< waits for the writer to make room.
+        drop,  ///< drops the chunk and counts it.
+    };
+
+    /// Background writer which calls the sink with chunks written from any thread, in batches.
+    /// Chunks are copied into a lock-free multi-producer ring of fixed-size slots,
+    /// a chunk occupies consecutive slots so that it is never interleaved with others.
+    template <class T = char>
+    class basic_async_callback_sink final
+    {
+    public:
+        using char_type = T;
+        using string_view_type = std::basic_string_view<char_type>;
+        using callback_type = std::function<void(string_view_type)>;
+        using if_full = async_callback_ostream_if_full;
+
+        static constexpr inline size_t slot_size = 256 - sizeof(uint64_t) - sizeof(uint32_t);
+        static constexpr inline size_t slot_chars = slot_size / sizeof(char_type);
+
+    private:
+        struct slot
+        {
+            std::atomic<uint64_t> sequence{}; // == position: free, == position + 1: ready
+            uint32_t length{};
+            char_type data[slot_chars];
+        };
+
+        callback_type sink_;
+        const if_full if_full_;
+        const size_t capacity_; // in slots, power of 2
+        std::unique_ptr<slot[]> slots_;
+
+        alignas(64) std::atomic<uint64_t> head_{};      // next position to reserve
+        alignas(64) std::atomic<uint64_t> completed_{}; // positions below this have been passed to the sink
+        std::atomic<uint64_t> dropped_{};                // dropped chars
+        std::atomic<bool> writer_waiting_{};
+
+        std::mutex mutex_{};
+        std::condition_variable writer_cv_{};
+        std::condition_variable completed_cv_{};
+        bool closing_{};
+        std::thread writer_{};
+
+        [[nodiscard]] static size_t round_up_to_power_of_2(size_t n) noexcept
+        {
+            size_t r = 1;
+            while (r < n) r <<= 1;
+            return r;
+        }
+
+        void wake_writer()
+        {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (writer_waiting_.load(std::memory_order_relaxed))
+            {
+                std::lock_guard lock(mutex_);
+                writer_cv_.notify_one();
+            }
+        }
+
+        // reserves `count` consecutive slots, or returns false if full and if_full::drop.
+        bool reserve(size_t count, uint64_t& position)
+        {
+            uint64_t pos = head_.load(std::memory_order_relaxed);
+            for (size_t spin = 0;; spin++)
+            {
+                const uint64_t last = pos + count - 1;
+                const uint64_t sequence = slots_[last & (capacity_ - 1)].sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<int64_t>(sequence - last);
+
+                if (diff == 0)
+                {
+                    if (head_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed, std::memory_order_relaxed))
+                    {
+                        position = pos;
+                        return true;
+                    }
+                }
+                else if (diff < 0) // full
+                {
+                    if (if_full_ == if_full::drop)
+                        return false;
+
+                    wake_writer();
+                    if (spin & 0xF) std::this_thread::yield();
+                    pos = head_.load(std::memory_order_relaxed);
+                }
+                else // taken by another producer
+                {
+                    pos = head_.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void write_chunk(string_view_type text)
+        {
+            const size_t count = (text.size() + slot_chars - 1) / slot_chars;
+
+            uint64_t position{};
+            if (!reserve(count, position))
+            {
+                dropped_.fetch_add(text.size(), std::memory_order_relaxed);
+                return;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                slot& s = slots_[(position + i) & (capacity_ - 1)];
+                const string_view_type part = text.substr(i * slot_chars, slot_chars);
+                std::copy(part.begin(), part.end(), s.data);
+                s.length = static_cast<uint32_t>(part.size());
+                s.sequence.store(position + i + 1, std::memory_order_release);
+            }
+        }
+
+        void writer_main()
+        {
+            std::basic_string<char_type> batch;
+            batch.reserve(capacity_ * slot_chars / 4);
+
+            uint64_t tail = 0;
+            for (;;)
+            {
+                // collects ready chunks.
+                for (;;)
+                {
+                    slot& s = slots_[tail & (capacity_ - 1)];
+                    if (s.sequence.load(std::memory_order_acquire) != tail + 1) break;
+                    batch.append(s.data, s.length);
+                    s.sequence.store(tail + capacity_, std::memory_order_release);
+                    tail++;
+                    if (batch.size() >= batch.capacity()) break;
+                }
+
+                if (!batch.empty())
+                {
+                    try { sink_(string_view_type(batch)); }
+                    catch (...) { /* ignore */ }
+                    batch.clear();
+
+                    std::lock_guard lock(mutex_);
+                    completed_.store(tail, std::memory_order_release);
+                    completed_cv_.notify_all();
+                    continue;
+                }
+
+                std::unique_lock lock(mutex_);
+                if (closing_ && head_.load(std::memory_order_acquire) == tail)
+                    return;
+
+                writer_waiting_.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (slots_[tail & (capacity_ - 1)].sequence.load(std::memory_order_relaxed) != tail + 1 && !closing_)
+                    writer_cv_.wait_for(lock, std::chrono::milliseconds(100));
+                writer_waiting_.store(false, std::memory_order_relaxed);
+            }
+        }
+
+    public:
+        /// @param sink called on the writer thread with batches of written text.
+        /// @param capacity ring capacity in chars (rounded up to the slots).
+        /// @param if_full_mode behavior on the ring is full.
+        explicit basic_async_callback_sink(callback_type sink, size_t capacity = 1024 * 1024, if_full if_full_mode = if_full::block)
+            : sink_(std::move(sink))
+            , if_full_(if_full_mode)
+            , capacity_(round_up_to_power_of_2(std::max<size_t>((capacity + slot_chars - 1) / slot_chars, 16)))
+            , slots_(std::make_unique<slot[]>(capacity_))
+        {
+            for (size_t i = 0; i < capacity_; i++)
+                slots_[i].sequence.store(i, std::memory_order_relaxed);
+
+            writer_ = std::thread([this] { writer_main(); });
+        }
+
+        basic_async_callback_sink(const basic_async_callback_sink& other) = delete;
+        basic_async_callback_sink(basic_async_callback_sink&& other) noexcept = delete;
+        basic_async_callback_sink& operator=(const basic_async_callback_sink& other) = delete;
+        basic_async_callback_sink& operator=(basic_async_callback_sink&& other) noexcept = delete;
+
+        /// Passes all written text to the sink, and stops the writer.
+        ~basic_async_callback_sink()
+        {
+            {
+                std::lock_guard lock(mutex_);
+                closing_ = true;
+                writer_cv_.notify_one();
+            }
+            writer_.join();
+        }
+
+        /// Enqueues the text (thread-safe).
+        /// The text larger than half of the ring is split into multiple chunks.
+        void write(string_view_type text)
+        {
+            const size_t max_chunk = capacity_ * slot_chars / 2;
+            while (!text.empty())
+            {
+                write_chunk(text.substr(0, max_chunk));
+                text.remove_prefix(std::min(text.size(), max_chunk));
+            }
+            wake_writer();
+        }
+
+        /// Waits for the sink to be called with all text written before this call (flush barrier).
+        void wait()
+        {
+            const uint64_t target = head_.load(std::memory_order_acquire);
+            {
+                std::lock_guard lock(mutex_);
+                writer_cv_.notify_one();
+            }
+
+            std::unique_lock lock(mutex_);
+            completed_cv_.wait(lock, [&] { return completed_.load(std::memory_order_acquire) >= target; });
+        }
+
+        /// Gets the number of dropped chars (if_full::drop).
+        [[nodiscard]] uint64_t dropped() const noexcept
+        {
+            return dropped_.load(std::memory_order_relaxed);
+        }
+    };
+
+    using async_callback_sink = basic_async_callback_sink<char>;
+
+    /// streambuf which writes flushed chunks to basic_async_callback_sink.
+    template <class T = char>
+    class basic_async_callback_ostreambuf : public std::basic_streambuf<T>
+    {
+    public:
+        using base_type = std::basic_streambuf<T>;
+        using char_type = typename base_type::char_type;
+        using traits_type = typename base_type::traits_type;
+        using int_type = typename base_type::int_type;
+        using pos_type = typename base_type::pos_type;
+        using off_type = typename base_type::off_type;
+        using sink_type = basic_async_callback_sink<T>;
+
+        std::shared_ptr<sink_type> sink_;
+        char_type buffer_[3072];
+
+        explicit basic_async_callback_ostreambuf(std::shared_ptr<sink_type> sink) : sink_(std::move(sink)) { base_type::setp(buffer_, buffer_ + std::size(buffer_)); }
+        basic_async_callback_ostreambuf(const basic_async_callback_ostreambuf& other) = delete;
+        basic_async_callback_ostreambuf(basic_async_callback_ostreambuf&& other) noexcept = delete;
+        basic_async_callback_ostreambuf& operator=(const basic_async_callback_ostreambuf& other) = delete;
+        basic_async_callback_ostreambuf& operator=(basic_async_callback_ostreambuf&& other) noexcept = delete;
+
+        ~basic_async_callback_ostreambuf() override
+        {
+            basic_async_callback_ostreambuf::sync();
+        }
+
+        int_type overflow(int_type c) override
+        {
+            sync();
+
+            if (c != traits_type::eof())
+            {
+                *base_type::pptr() = traits_type::to_char_type(c);
+                base_type::pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override
+        {
+            if (base_type::pbase() == base_type::pptr()) { return 0; }
+
+            sink_->write(std::basic_string_view<char_type>(base_type::pbase(), static_cast<size_t>(base_type::pptr() - base_type::pbase())));
+            base_type::setp(buffer_, buffer_ + std::size(buffer_));
+            return 0;
+        }
+    };
+
+    /// ostream which calls the sink on a background writer thread.
+    /// The ostream itself is not thread-safe, but ostreams on the same sink can be used from different threads.
+    ///
+    /// usage:
+    /// <pre>
+    ///   xtl::async_callback_ostream os([](std::string_view text) { fwrite(text.data(), 1, text.size(), fp); });
+    ///   os << "hello" << std::endl;   // copied into the ring, and returns.
+    ///   os.flush_and_wait();          // e.g. on shutdown
+    /// </pre>
+    template <class T = char>
+    class basic_async_callback_ostream final
+        : private basic_async_callback_ostreambuf<T>
+        , public std::basic_ostream<T>
+    {
+        using streambuf = basic_async_callback_ostreambuf<T>;
+
+    public:
+        using sink_type = basic_async_callback_sink<T>;
+        using if_full = async_callback_ostream_if_full;
+
+        explicit basic_async_callback_ostream(std::shared_ptr<sink_type> sink)
+            : streambuf(std::move(sink))
+            , std::basic_ostream<T>(static_cast<streambuf*>(this)) { }
+
+        explicit basic_async_callback_ostream(typename sink_type::callback_type sink, size_t capacity = 1024 * 1024, if_full if_full_mode = if_full::block)
+            : basic_async_callback_ostream(std::make_shared<sink_type>(std::move(sink), capacity, if_full_mode)) { }
+
+        basic_async_callback_ostream(const basic_async_callback_ostream& other) = delete;
+        basic_async_callback_ostream(basic_async_callback_ostream&& other) noexcept = delete;
+        basic_async_callback_ostream& operator=(const basic_async_callback_ostream& other) = delete;
+        basic_async_callback_ostream& operator=(basic_async_callback_ostream&& other) noexcept = delete;
+        ~basic_async_callback_ostream() override = default;
+
+        [[nodiscard]] const std::shared_ptr<sink_type>& sink() const noexcept { return streambuf::sink_; }
+
+        /// Flushes, and waits for the sink to be called with all text written to the sink (flush barrier).
+        void flush_and_wait()
+        {
+            std::basic_ostream<T>::flush();
+            streambuf::sink_->wait();
+        }
+    };
+
+    using async_callback_ostream = basic_async_callback_ostream<char>;
+}
@@ -0,0 +1,181 @@
+/// @file
+/// @brief  xtl::async_event_callback
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <tuple>
+#include <vector>
+#include <utility>
+#include <type_traits>
+
+#include "xtl_delegate.h"
+#include "xtl_event_callback.h"
+#include "xtl_spin_lock_mutex.h"
+#include "xtl_worker_thread_pool.h"
+
+namespace xtl
+{
+    enum struct async_event_coalescing
+    {
+        none,   // delivers every raise, in order.
+        latest, // delivers only the latest arguments per drain cycle.
+        batch,  // delivers all arguments raised since the last drain cycle at once, as `const std::vector<std::tuple<...>>&`.
+    };
+
+    template <class F, async_event_coalescing Coalescing = async_event_coalescing::none> class async_event_callback;
+
+    /// Event callback which defers delivery to subscribers.
+    /// `raise` only stores the arguments, and schedules a drain cycle on the executor if not yet scheduled.
+    /// Without executor, the owner calls `drain()` periodically (e.g. from its own message loop).
+    template <class...TArgs, async_event_coalescing Coalescing>
+    class async_event_callback<void(TArgs ...), Coalescing> final
+    {
+    public:
+        using coalescing = async_event_coalescing;
+        using arguments = std::tuple<std::decay_t<TArgs>...>;
+        using event_type = std::conditional_t<Coalescing == coalescing::batch, event_callback<void(const std::vector<arguments>&)>, event_callback<void(TArgs ...)>>;
+        using subscribe_id = typename event_type::subscribe_id;
+        using callback = typename event_type::callback;
+        using executor = delegate<void(delegate<void()>)>;
+
+    private:
+        event_type event_{};
+        executor executor_{};
+
+        spin_lock_mutex mutex_{}; // guards pending_ and scheduled_
+        std::vector<arguments> pending_{};
+        bool scheduled_{};
+
+        std::mutex drain_mutex_{}; // serializes drain cycles
+        std::vector<arguments> draining_{};
+
+        std::mutex in_flight_mutex_{};
+        std::condition_variable in_flight_cv_{};
+        size_t in_flight_{}; // scheduled drain cycles
+
+        /// Task of a scheduled drain cycle.
+        /// Releases the cycle on destruction even if the executor rejects (or throws, or discards) it without running,
+        /// so that the destructor does not wait forever and the next raise schedules again.
+        class drain_cycle final
+        {
+            async_event_callback* owner_{};
+            bool ran_{};
+
+        public:
+            explicit drain_cycle(async_event_callback* owner) : owner_(owner)
+            {
+                std::lock_guard lock(owner_->in_flight_mutex_);
+                ++owner_->in_flight_;
+            }
+
+            drain_cycle(const drain_cycle& other) = delete;
+            drain_cycle(drain_cycle&& other) noexcept : owner_(std::exchange(other.owner_, nullptr)), ran_(other.ran_) { }
+            drain_cycle& operator=(const drain_cycle& other) = delete;
+            drain_cycle& operator=(drain_cycle&& other) noexcept = delete;
+
+            ~drain_cycle()
+            {
+                if (!owner_) return;
+
+                if (!ran_)
+                {
+                    std::lock_guard lock(owner_->mutex_);
+                    owner_->scheduled_ = false; // pending arguments are scheduled by the next raise (or drain()).
+                }
+
+                std::lock_guard lock(owner_->in_flight_mutex_);
+                --owner_->in_flight_;
+                owner_->in_flight_cv_.notify_all();
+            }
+
+            void operator()()
+            {
+                ran_ = true;
+                owner_->drain();
+            }
+        };
+
+    public:
+        /// manual drain mode
+        async_event_callback() = default;
+
+        /// drains on the executor
+        /// The executor must run or destroy the task (destroying it without running releases the cycle).
+        explicit async_event_callback(executor executor) : executor_(std::move(executor)) { }
+
+        /// drains on the pool
+        /// If the pool is shutting down, the rejected task is destroyed without running, and releases the cycle.
+        explicit async_event_callback(worker_thread_pool& pool) : executor_([&pool](delegate<void()> task) { static_cast<void>(pool.post(std::move(task))); }) { }
+
+        async_event_callback(const async_event_callback& other) = delete;
+        async_event_callback(async_event_callback&& other) noexcept = delete;
+        async_event_callback& operator=(const async_event_callback& other) = delete;
+        async_event_callback& operator=(async_event_callback&& other) noexcept = delete;
+
+        ~async_event_callback()
+        {
+            // waits for scheduled drain cycles
+            std::unique_lock lock(in_flight_mutex_);
+            in_flight_cv_.wait(lock, [this] { return in_flight_ == 0; });
+        }
+
+        [[nodiscard]] size_t count() const noexcept { return event_.count(); }
+        [[nodiscard]] bool empty() const noexcept { return event_.empty(); }
+        void unsubscribe_all() noexcept { return event_.unsubscribe_all(); }
+        template <class F> subscribe_id subscribe(F&& f, int priority = 0) { return event_.subscribe(std::forward<F>(f), priority); }
+        template <class F> void subscribe(subscribe_id id, F&& f, int priority = 0) { return event_.subscribe(id, std::forward<F>(f), priority); }
+        bool unsubscribe(subscribe_id id) { return event_.unsubscribe(id); }
+
+        template <class...Args>
+        void raise(Args&&...params)
+        {
+            bool schedule;
+            {
+                std::lock_guard lock(mutex_);
+                if (Coalescing == coalescing::latest && !pending_.empty()) { pending_.front() = arguments(std::forward<Args>(params)...); }
+                else { pending_.emplace_back(std::forward<Args>(params)...); }
+                schedule = !std::exchange(scheduled_, true);
+            }
+
+            if (schedule && executor_)
+            {
+                // exceptions from the executor propagate after the cycle is released.
+                executor_(delegate<void()>(drain_cycle(this)));
+            }
+        }
+
+        /// Delivers pending arguments to subscribers.
+        /// returns the number of raises consumed.
+        /// Note: must not be called from subscribers.
+        size_t drain()
+        {
+            std::lock_guard lock(drain_mutex_);
+            {
+                std::lock_guard pending_lock(mutex_);
+                std::swap(pending_, draining_);
+                scheduled_ = false;
+            }
+
+            const size_t count = draining_.size();
+            if (count != 0)
+            {
+                if constexpr (Coalescing == coalescing::batch)
+                {
+                    event_.raise(std::as_const(draining_));
+                }
+                else
+                {
+                    for (auto& args : draining_)
+                        std::apply([this](auto&&... a) { event_.raise(std::move(a)...); }, std::move(args));
+                }
+                draining_.clear(); // keeps capacity
+            }
+
+            return count;
+        }
+    };
+}
\ No newline at end of file
@@ -0,0 +1,495 @@
+/// @file
+/// @brief  xtl::binary_logger - deferred-formatting logger which records raw arguments into per-thread rings
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <ostream>
+#include <algorithm>
+#include <type_traits>
+#include <condition_variable>
+
+#include "xtl_timestamp.h"
+#include "xtl_fast_timestamp.h"
+
+namespace xtl
+{
+    /// Static format descriptor of a log statement.
+    /// `{}` in the text is replaced by the next argument, `{{` and `}}` are escaped braces.
+    /// The descriptor must outlive the records (declare it `static constexpr`).
+    struct binary_log_format
+    {
+        std::string_view text;
+    };
+
+    namespace binary_logger_detail
+    {
+        /// Maps an argument type to the type stored in the record.
+        template <class T, class = void>
+        struct encoded
+        {
+            using type = std::conditional_t<std::is_convertible_v<const T&, std::string_view>, std::string_view, void>;
+        };
+
+        template <class T>
+        struct encoded<T, std::enable_if_t<std::is_arithmetic_v<T>>> { using type = T; };
+
+        template <class T>
+        struct encoded<T, std::enable_if_t<std::is_enum_v<T>>> { using type = std::underlying_type_t<T>; };
+
+        // object pointers are logged as addresses (not the pointees, which may be gone on drain), function pointers are rejected.
+        template <class T>
+        struct encoded<T, std::enable_if_t<std::is_pointer_v<T> && std::is_object_v<std::remove_pointer_t<T>> && !std::is_convertible_v<T, std::string_view>>> { using type = const void*; };
+
+        template <> struct encoded<timestamp> { using type = timestamp; };
+        template <> struct encoded<fast_timestamp> { using type = fast_timestamp; };
+        template <> struct encoded<const char*> { using type = std::string_view; };
+        template <> struct encoded<char*> { using type = std::string_view; };
+
+        template <class T>
+        using encoded_t = typename encoded<std::decay_t<T>>::type;
+
+        // char strings are copied inline, not captured as pointers.
+        static_assert(std::is_same_v<encoded_t<const char*>, std::string_view>);
+        static_assert(std::is_same_v<encoded_t<char*>, std::string_view>);
+        static_assert(std::is_same_v<encoded_t<const char(&)[4]>, std::string_view>);
+        static_assert(std::is_same_v<encoded_t<std::string>, std::string_view>);
+        static_assert(std::is_same_v<encoded_t<const int*>, const void*>);
+        static_assert(std::is_void_v<encoded_t<void(*)()>>);
+
+        template <class E, class T>
+        [[nodiscard]] inline size_t encoded_size(const T& value) noexcept
+        {
+            if constexpr (std::is_same_v<E, std::string_view>)
+            {
+                if constexpr (std::is_pointer_v<std::decay_t<T>>)
+                {
+                    const char* p = value;
+                    return sizeof(uint32_t) + (p ? std::char_traits<char>::length(p) : 0);
+                }
+                else
+                    return sizeof(uint32_t) + std::string_view(value).size();
+            }
+            else
+            {
+                return sizeof(E);
+            }
+        }
+
+        template <class E, class T>
+        inline std::byte* encode(std::byte* out, const T& value) noexcept
+        {
+            if constexpr (std::is_same_v<E, std::string_view>)
+            {
+                std::string_view s;
+                if constexpr (std::is_pointer_v<std::decay_t<T>>)
+                {
+                    const char* p = value;
+                    s = p ? std::string_view(p) : std::string_view();
+                }
+                else s = std::string_view(value);
+
+                const auto length = static_cast<uint32_t>(s.size());
+                std::memcpy(out, &length, sizeof(length));
+                if (!s.empty()) std::memcpy(out + sizeof(length), s.data(), s.size());
+                return out + sizeof(length) + s.size();
+            }
+            else
+            {
+                const E e = static_cast<E>(value);
+                std::memcpy(out, &e, sizeof(E));
+                return out + sizeof(E);
+            }
+        }
+
+        inline void write_timestamp(std::ostream& os, timestamp time, timestamp_format format = timestamp_format::localtime)
+        {
+            const auto str = time.to_fixed_string(format);
+            os << std::string_view(str.data(), str.size());
+        }
+
+        template <class E>
+        inline const std::byte* decode_argument(std::ostream& os, const std::byte* in)
+        {
+            if constexpr (std::is_same_v<E, std::string_view>)
+            {
+                uint32_t length{};
+                std::memcpy(&length, in, sizeof(length));
+                os << std::string_view(reinterpret_cast<const char*>(in + sizeof(length)), length);
+                return in + sizeof(length) + length;
+            }
+            else
+            {
+                E e{};
+                std::memcpy(&e, in, sizeof(E));
+
+                if constexpr (std::is_same_v<E, timestamp>) write_timestamp(os, e);
+                else if constexpr (std::is_same_v<E, fast_timestamp>) write_timestamp(os, e.to_timestamp());
+                else if constexpr (std::is_same_v<E, char> || std::is_same_v<E, signed char> || std::is_same_v<E, unsigned char>) os << static_cast<char>(e);
+                else os << e;
+
+                return in + sizeof(E);
+            }
+        }
+
+        /// Writes the text up to the next placeholder (or the end), and returns the rest after it.
+        inline std::string_view write_literal(std::ostream& os, std::string_view format)
+        {
+            size_t i = 0;
+            while (i < format.size())
+            {
+                const size_t brace = format.find_first_of("{}", i);
+                os << format.substr(i, brace - i);
+                if (brace == std::string_view::npos) return {};
+
+                const std::string_view token = format.substr(brace, 2);
+                if (token == "{}") return format.substr(brace + 2);
+
+                os << format[brace];
+                i = brace + (token == "{{" || token == "}}" ? 2 : 1);
+            }
+            return {};
+        }
+
+        using decode_function = void(*)(std::ostream& os, std::string_view format, const std::byte* arguments);
+
+        template <class... E>
+        void decode(std::ostream& os, std::string_view format, const std::byte* arguments)
+        {
+            ((format = write_literal(os, format), arguments = decode_argument<E>(os, arguments)), ...);
+            static_cast<void>(arguments);
+            write_literal(os, format);
+        }
+
+        struct record_header
+        {
+            uint32_t size;    // in bytes including this header, multiple of alignment.
+            uint32_t padding; // 1: skip to the ring end.
+            const binary_log_format* format;
+            decode_function decode;
+            fast_timestamp time;
+        };
+
+        static constexpr inline size_t record_alignment = alignof(record_header);
+
+        /// Single-producer single-consumer byte ring, owned by a logger and written by a thread.
+        struct alignas(64) thread_ring
+        {
+            const size_t capacity; // power of 2
+            std::unique_ptr<std::byte[]> buffer;
+
+            alignas(64) std::atomic<uint64_t> head{}; // written by the producer
+            uint64_t cached_tail{};                   // producer's view of tail
+            std::atomic<bool> closed{};               // the thread has exited
+
+            alignas(64) std::atomic<uint64_t> tail{}; // written by the consumer
+
+            explicit thread_ring(size_t capacity)
+                : capacity(capacity)
+                , buffer(std::make_unique<std::byte[]>(capacity))
+            {
+            }
+
+            [[nodiscard]] std::byte* at(uint64_t position) const noexcept { return buffer.get() + (position & (capacity - 1)); }
+
+            /// Reserves `size` contiguous bytes, or returns nullptr if full.
+            [[nodiscard]] std::byte* reserve(size_t size, uint64_t& position) noexcept
+            {
+                uint64_t pos = head.load(std::memory_order_relaxed);
+                const size_t contiguous = capacity - static_cast<size_t>(pos & (capacity - 1));
+                const size_t required = size + (contiguous < size ? contiguous : 0);
+
+                if (pos + required - cached_tail > capacity)
+                {
+                    cached_tail = tail.load(std::memory_order_acquire);
+                    if (pos + required - cached_tail > capacity)
+                        return nullptr;
+                }
+
+                if (contiguous < size)
+                {
+                    auto* padding = reinterpret_cast<uint32_t*>(at(pos)); // record_header::size and padding
+                    padding[0] = static_cast<uint32_t>(contiguous);
+                    padding[1] = 1;
+                    pos += contiguous;
+                }
+
+                position = pos;
+                return at(pos);
+            }
+
+            void commit(uint64_t position, size_t size) noexcept
+            {
+                head.store(position + size, std::memory_order_release);
+            }
+        };
+
+        inline std::atomic<uint64_t> next_instance_id{1};
+    }
+
+    /// Deferred-formatting logger.
+    /// write() copies a pointer to the static format descriptor, a timestamp (fast_timestamp) and the raw argument bytes
+    /// (arithmetic values, enums, object pointers as addresses, timestamps, and strings including `const char*` copied inline) into a ring of the calling thread, without locking or allocation.
+    /// Formatting is deferred to drain(), which is called by a binary_log_writer thread or on demand (e.g. on shutdown, or never).
+    /// If the ring of the thread is full, the record is dropped and counted.
+    ///
+    /// usage:
+    /// <pre>
+    ///   xtl::binary_logger logger;
+    ///   xtl::binary_log_writer writer(logger, os); // e.g. callback_ostream
+    ///
+    ///   static constexpr xtl::binary_log_format request_done{"request {} done in {} ms: {}"};
+    ///   logger.write(request_done, id, elapsed_ms, std::string_view(name));
+    /// </pre>
+    class binary_logger final
+    {
+        using thread_ring = binary_logger_detail::thread_ring;
+        using record_header = binary_logger_detail::record_header;
+
+        // rings of the current thread, closed on the thread exit.
+        struct thread_rings
+        {
+            uint64_t last_id{};
+            thread_ring* last{};
+            std::vector<std::pair<uint64_t, std::shared_ptr<thread_ring>>> rings{};
+
+            thread_rings() = default;
+            thread_rings(const thread_rings& other) = delete;
+            thread_rings(thread_rings&& other) noexcept = delete;
+            thread_rings& operator=(const thread_rings& other) = delete;
+            thread_rings& operator=(thread_rings&& other) noexcept = delete;
+
+            ~thread_rings()
+            {
+                for (auto& r : rings)
+                    r.second->closed.store(true, std::memory_order_release);
+            }
+        };
+
+        const uint64_t instance_id_ = binary_logger_detail::next_instance_id.fetch_add(1, std::memory_order_relaxed);
+        const size_t ring_capacity_;
+
+        std::mutex rings_mutex_{};
+        std::vector<std::shared_ptr<thread_ring>> rings_{};
+
+        std::atomic<uint64_t> dropped_{}; // dropped records (written only on overflow)
+
+        std::mutex drain_mutex_{};
+
+        [[nodiscard]] static size_t round_up_to_power_of_2(size_t n) noexcept
+        {
+            size_t r = 1;
+            while (r < n) r <<= 1;
+            return r;
+        }
+
+        [[nodiscard]] thread_ring* current_thread_ring()
+        {
+            static thread_local thread_rings local;
+            if (local.last_id == instance_id_) return local.last;
+            return find_or_add_thread_ring(local);
+        }
+
+        [[nodiscard]] thread_ring* find_or_add_thread_ring(thread_rings& local)
+        {
+            auto it = std::find_if(local.rings.begin(), local.rings.end(), [this](const auto& r) { return r.first == instance_id_; });
+            if (it == local.rings.end())
+            {
+                auto ring = std::make_shared<thread_ring>(ring_capacity_);
+                {
+                    std::lock_guard lock(rings_mutex_);
+                    rings_.push_back(ring);
+                }
+                local.rings.emplace_back(instance_id_, std::move(ring));
+                it = std::prev(local.rings.end());
+            }
+
+            local.last_id = instance_id_;
+            local.last = it->second.get();
+            return local.last;
+        }
+
+    public:
+        /// @param ring_capacity ring capacity of each thread in bytes (rounded up to a power of 2).
+        explicit binary_logger(size_t ring_capacity = 1024 * 1024)
+            : ring_capacity_(round_up_to_power_of_2(std::max<size_t>(ring_capacity, 4096)))
+        {
+            fast_timestamp::calibrate();
+        }
+
+        binary_logger(const binary_logger& other) = delete;
+        binary_logger(binary_logger&& other) noexcept = delete;
+        binary_logger& operator=(const binary_logger& other) = delete;
+        binary_logger& operator=(binary_logger&& other) noexcept = delete;
+
+        /// Undrained records are discarded.
+        ~binary_logger() = default;
+
+        /// Records a log statement (thread-safe, lock-free).
+        /// Records larger than a quarter of the ring are dropped.
+        template <class... Args>
+        void write(const binary_log_format& format, const Args&... args) noexcept
+        {
+            static_assert((!std::is_void_v<binary_logger_detail::encoded_t<Args>> && ...),
+                          "binary_logger supports arithmetic, enum, object pointer (logged as address), timestamp and string arguments.");
+
+            const fast_timestamp time = fast_timestamp::now();
+
+            thread_ring* ring{};
+            try { ring = current_thread_ring(); }
+            catch (...) { return; }
+
+            const size_t size = (sizeof(record_header) + (size_t{0} + ... + binary_logger_detail::encoded_size<binary_logger_detail::encoded_t<Args>>(args))
+                + binary_logger_detail::record_alignment - 1) & ~(binary_logger_detail::record_alignment - 1);
+
+            uint64_t position{};
+            std::byte* out = size <= ring->capacity / 4 ? ring->reserve(size, position) : nullptr;
+            if (!out)
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            // records are aligned for the header in the ring.
+            new(out) record_header{
+                static_cast<uint32_t>(size), 0, &format,
+                &binary_logger_detail::decode<binary_logger_detail::encoded_t<Args>...>, time};
+
+            out += sizeof(record_header);
+            ((out = binary_logger_detail::encode<binary_logger_detail::encoded_t<Args>>(out, args)), ...);
+
+            ring->commit(position, size);
+        }
+
+        /// Formats the recorded statements into `os` as lines of "<time> <message>", and removes them.
+        /// Records of different threads are merged in time order (within a drain).
+        /// @returns the number of formatted records.
+        size_t drain(std::ostream& os, timestamp_format time_format = timestamp_format::localtime)
+        {
+            std::lock_guard drain_lock(drain_mutex_);
+
+            std::vector<std::shared_ptr<thread_ring>> rings;
+            {
+                std::lock_guard lock(rings_mutex_);
+                rings = rings_;
+            }
+
+            struct entry
+            {
+                fast_timestamp time;
+                const record_header* header;
+            };
+
+            std::vector<entry> entries;
+            std::vector<uint64_t> heads(rings.size());
+            std::vector<bool> closed(rings.size());
+            for (size_t i = 0; i < rings.size(); i++)
+            {
+                thread_ring& ring = *rings[i];
+                closed[i] = ring.closed.load(std::memory_order_acquire);
+                heads[i] = ring.head.load(std::memory_order_acquire);
+
+                for (uint64_t pos = ring.tail.load(std::memory_order_relaxed); pos != heads[i];)
+                {
+                    auto* header = reinterpret_cast<const record_header*>(ring.at(pos));
+                    if (!header->padding) entries.push_back(entry{header->time, header});
+                    pos += header->size;
+                }
+            }
+
+            std::stable_sort(entries.begin(), entries.end(), [](const entry& a, const entry& b) { return a.time < b.time; });
+
+            for (const entry& e : entries)
+            {
+                binary_logger_detail::write_timestamp(os, e.time.to_timestamp(), time_format);
+                os << ' ';
+                e.header->decode(os, e.header->format->text, reinterpret_cast<const std::byte*>(e.header + 1));
+                os << '\n';
+            }
+
+            for (size_t i = 0; i < rings.size(); i++)
+                rings[i]->tail.store(heads[i], std::memory_order_release);
+
+            // removes drained rings of exited threads.
+            {
+                std::lock_guard lock(rings_mutex_);
+                for (size_t i = 0; i < rings.size(); i++)
+                {
+                    if (!closed[i]) continue;
+                    rings_.erase(std::find(rings_.begin(), rings_.end(), rings[i]));
+                }
+            }
+
+            return entries.size();
+        }
+
+        /// Gets the number of dropped records.
+        [[nodiscard]] uint64_t dropped() const noexcept
+        {
+            return dropped_.load(std::memory_order_relaxed);
+        }
+    };
+
+    /// Background thread which drains the binary_logger into the ostream periodically, and on destruction.
+    /// The ostream is used only on the writer thread (and by the destructor).
+    class binary_log_writer final
+    {
+        binary_logger* logger_;
+        std::ostream* os_;
+        timestamp_format time_format_;
+
+        std::mutex mutex_{};
+        std::condition_variable cv_{};
+        bool stop_{};
+        std::thread thread_{};
+
+    public:
+        explicit binary_log_writer(binary_logger& logger, std::ostream& os, std::chrono::microseconds period = std::chrono::milliseconds(10), timestamp_format time_format = timestamp_format::localtime)
+            : logger_(&logger)
+            , os_(&os)
+            , time_format_(time_format)
+        {
+            thread_ = std::thread([this, period]
+            {
+                std::unique_lock lock(mutex_);
+                while (!cv_.wait_for(lock, period, [this] { return stop_; }))
+                {
+                    lock.unlock();
+                    if (logger_->drain(*os_, time_format_)) os_->flush();
+                    lock.lock();
+                }
+            });
+        }
+
+        binary_log_writer(const binary_log_writer& other) = delete;
+        binary_log_writer(binary_log_writer&& other) noexcept = delete;
+        binary_log_writer& operator=(const binary_log_writer& other) = delete;
+        binary_log_writer& operator=(binary_log_writer&& other) noexcept = delete;
+
+        ~binary_log_writer()
+        {
+            {
+                std::lock_guard lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            thread_.join();
+
+            logger_->drain(*os_, time_format_);
+            os_->flush();
+        }
+    };
+}
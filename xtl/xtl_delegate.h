@@ -6,26 +6,40 @@
 #pragma once
 
 #include <cassert>
+#include <atomic>
 #include <type_traits>
 #include <utility>
 
 #include <memory>
+#include <memory_resource>
 #include <functional>
 
 #include "xtl_small_object_optimization.h"
 
 namespace xtl
 {
-    template <typename T>
+    /// The default inline buffer size of delegate.
+    static constexpr inline size_t delegate_default_inline_size = sizeof(void*) * 8;
+
+    /// delegate<R(A...), InlineSize, AllowHeap>
+    ///   InlineSize: the size of the inline buffer, callables larger than it are allocated from heap.
+    ///   AllowHeap: if false, constructing from a callable which does not fit in the inline buffer is a compile error.
+    template <typename T, size_t InlineSize = delegate_default_inline_size, bool AllowHeap = true>
     class delegate;
 
-    template <class R, class... A>
-    class delegate<R(A...)>
+    template <typename T, size_t InlineSize = delegate_default_inline_size>
+    class copyable_delegate;
+
+    template <class R, class... A, size_t InlineSize, bool AllowHeap>
+    class delegate<R(A...), InlineSize, AllowHeap>
     {
+        static_assert(InlineSize >= sizeof(void*));
+        template <typename, size_t> friend class copyable_delegate;
+
     public:
         struct alignment
         {
-            alignas(std::max_align_t) std::byte data[sizeof(void*) * 8];
+            alignas(std::max_align_t) std::byte data[InlineSize];
         };
 
     private:
@@ -35,6 +49,7 @@ namespace xtl
             using memory = typename base::memory;
             using move_constructor_function = typename base::move_constructor_function;
             using destructor_function = typename base::destructor_function;
+            using copy_constructor_function = typename base::copy_constructor_function;
 
             using invoke_function = R(*)(memory&, A...);
 
@@ -47,15 +62,21 @@ namespace xtl
             struct vtable
             {
                 invoke_function invoke{};
-                move_constructor_function move_ctor{};
-                destructor_function dtor{};
+                move_constructor_function move_ctor{}; // nullptr: moved by memcpy
+                destructor_function dtor{};            // nullptr: no-op
+                copy_constructor_function copy_ctor{}; // nullptr: not copyable
             };
 
-            template <class T>
+            template <class T, bool Copyable = false>
             static constexpr inline vtable vtable_for = {
                 &soo::invoke<T>,
-                &base::template move_construct<T>,
-                &base::template destruct<T>
+                base::template move_constructor_for<T>,
+                base::template destructor_for<T>,
+                []
+                {
+                    if constexpr (Copyable) return &base::template copy_construct<T>;
+                    else return copy_constructor_function{};
+                }(),
             };
         };
 
@@ -63,14 +84,17 @@ namespace xtl
         const typename soo::vtable* vtable_{};
 
         // emplace
-        template <class T>
-        void emplace(T&& arg)
+        template <bool Copyable = false, class T>
+        void emplace(std::pmr::memory_resource* resource, T&& arg)
         {
             using U = std::remove_cv_t<std::remove_reference_t<T>>;
+            static_assert(AllowHeap || soo::template use_soo<U>,
+                "xtl::inplace_delegate: the callable does not fit in the inline buffer "
+                "(too large, over-aligned, or not nothrow-move-constructible). Enlarge InlineSize or reduce the captures.");
 
             this->reset();
-            soo::template construct<U>(this->memory_, std::forward<T>(arg));
-            this->vtable_ = &soo::template vtable_for<U>;
+            soo::template construct_on<U>(this->memory_, resource, std::forward<T>(arg));
+            this->vtable_ = &soo::template vtable_for<U, Copyable>;
         }
 
         // move from
@@ -79,7 +103,17 @@ namespace xtl
             if (other.vtable_)
             {
                 this->vtable_ = std::exchange(other.vtable_, nullptr);
-                this->vtable_->move_ctor(this->memory_, std::move(other.memory_));
+                soo::relocate(this->memory_, std::move(other.memory_), this->vtable_->move_ctor);
+            }
+        }
+
+        // copy from (used by copyable_delegate)
+        void copy_assign(const delegate& other)
+        {
+            if (other.vtable_)
+            {
+                other.vtable_->copy_ctor(this->memory_, other.memory_);
+                this->vtable_ = other.vtable_;
             }
         }
 
@@ -88,7 +122,7 @@ namespace xtl
         {
             if (this->vtable_)
             {
-                this->vtable_->dtor(this->memory_);
+                soo::destroy(this->memory_, this->vtable_->dtor);
                 this->vtable_ = nullptr;
             }
         }
@@ -123,12 +157,12 @@ namespace xtl
             return *this;
         }
 
-        // from function pointer
-        delegate(R (*function_pointer)(A...)) { this->emplace(std::move(function_pointer)); }
+        // from function pointer (always fits in the inline buffer)
+        delegate(R (*function_pointer)(A...)) { this->emplace(nullptr, std::move(function_pointer)); }
 
 #if defined(_MSC_VER) && defined(_M_IX86)
-        delegate(R(__stdcall* function_pointer)(A...)) { this->emplace(std::move(function_pointer)); }
-        delegate(R(__thiscall* function_pointer)(A...)) { this->emplace(std::move(function_pointer)); }
+        delegate(R(__stdcall* function_pointer)(A...)) { this->emplace(nullptr, std::move(function_pointer)); }
+        delegate(R(__thiscall* function_pointer)(A...)) { this->emplace(nullptr, std::move(function_pointer)); }
 #endif
 
         // from functor
@@ -140,7 +174,19 @@ namespace xtl
                   >* = nullptr>
         delegate(Functor&& functor)
         {
-            this->emplace(std::forward<Functor>(functor));
+            this->emplace(std::pmr::get_default_resource(), std::forward<Functor>(functor));
+        }
+
+        // from functor, allocates from `resource` if it does not fit in the inline buffer
+        template <class Functor, std::enable_if_t<
+                      std::is_class_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      std::is_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>, Functor> &&
+                      std::is_nothrow_move_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      std::is_invocable_r_v<R, Functor, A...>
+                  >* = nullptr>
+        delegate(std::allocator_arg_t, std::pmr::memory_resource* resource, Functor&& functor)
+        {
+            this->emplace(resource, std::forward<Functor>(functor));
         }
 
         // from member-function-pointer-like type with binding instance-pointer-like type
@@ -175,6 +221,26 @@ namespace xtl
             if (this->vtable_) return this->vtable_->invoke(this->memory_, std::forward<A>(args)...);
             else throw std::bad_function_call();
         }
+
+        // gets the pointer to the stored callable if it is T, otherwise nullptr.
+        template <class T>
+        [[nodiscard]] T* target() noexcept
+        {
+            if constexpr (std::is_nothrow_move_constructible_v<T> && std::is_invocable_r_v<R, T&, A...>)
+            {
+                if (this->vtable_ && this->vtable_ == &soo::template vtable_for<T>)
+                    return soo::template pointer<T>(this->memory_);
+            }
+
+            return nullptr;
+        }
+
+        // gets the pointer to the stored callable if it is T, otherwise nullptr.
+        template <class T>
+        [[nodiscard]] const T* target() const noexcept
+        {
+            return const_cast<delegate*>(this)->template target<T>();
+        }
     };
 
     // CTAD guilds
@@ -208,6 +274,270 @@ namespace xtl
     // any_invokable (C++23)
     template <class T> using any_invokable = delegate<T>;
 
+    // heap-free delegate, rejects the callable that does not fit in the inline buffer at compile time.
+    template <class T, size_t InlineSize = delegate_default_inline_size> using inplace_delegate = delegate<T, InlineSize, false>;
+
+    /// copyable delegate - accepts only copy constructible callables, and copies them via the vtable.
+    template <class R, class... A, size_t InlineSize>
+    class copyable_delegate<R(A...), InlineSize>
+    {
+        using delegate_type = delegate<R(A...), InlineSize>;
+        delegate_type delegate_{};
+
+    public:
+        // empty delegate
+        copyable_delegate() = default;
+
+        // from nullptr (empty)
+        copyable_delegate(std::nullptr_t) { }
+
+        // copy
+        copyable_delegate(const copyable_delegate& other)
+        {
+            this->delegate_.copy_assign(other.delegate_);
+        }
+
+        // copy assign
+        copyable_delegate& operator=(const copyable_delegate& other)
+        {
+            if (std::addressof(other) != this)
+            {
+                copyable_delegate tmp(other);
+                *this = std::move(tmp);
+            }
+            return *this;
+        }
+
+        // move
+        copyable_delegate(copyable_delegate&& other) noexcept = default;
+
+        // move assign
+        copyable_delegate& operator=(copyable_delegate&& other) noexcept = default;
+
+        // destruct
+        ~copyable_delegate() = default;
+
+        // from function pointer
+        copyable_delegate(R (*function_pointer)(A...)) { this->delegate_.template emplace<true>(nullptr, function_pointer); }
+
+        // from functor
+        template <class Functor, std::enable_if_t<
+                      std::is_class_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      !std::is_same_v<std::remove_cv_t<std::remove_reference_t<Functor>>, copyable_delegate> &&
+                      std::is_copy_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      std::is_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>, Functor> &&
+                      std::is_nothrow_move_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      std::is_invocable_r_v<R, Functor, A...>
+                  >* = nullptr>
+        copyable_delegate(Functor&& functor)
+        {
+            this->delegate_.template emplace<true>(std::pmr::get_default_resource(), std::forward<Functor>(functor));
+        }
+
+        // from functor, allocates from `resource` if it does not fit in the inline buffer
+        template <class Functor, std::enable_if_t<
+                      std::is_class_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      std::is_copy_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      std::is_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>, Functor> &&
+                      std::is_nothrow_move_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      std::is_invocable_r_v<R, Functor, A...>
+                  >* = nullptr>
+        copyable_delegate(std::allocator_arg_t, std::pmr::memory_resource* resource, Functor&& functor)
+        {
+            this->delegate_.template emplace<true>(resource, std::forward<Functor>(functor));
+        }
+
+        // from member-function-pointer-like type with binding instance-pointer-like type
+        template <class P, class F, std::enable_if_t<
+                      std::is_copy_constructible_v<std::remove_cv_t<std::remove_reference_t<P>>> &&
+                      std::is_nothrow_move_constructible_v<std::remove_cv_t<std::remove_reference_t<P>>> &&
+                      std::is_copy_constructible_v<std::remove_cv_t<std::remove_reference_t<F>>> &&
+                      std::is_nothrow_move_constructible_v<std::remove_cv_t<std::remove_reference_t<F>>> &&
+                      std::is_invocable_r_v<R, F, P, A...>
+                  >* = nullptr>
+        copyable_delegate(P&& instance_pointer, F&& member_function)
+            : copyable_delegate([instance_pointer = std::forward<P>(instance_pointer), member_function = std::forward<F>(member_function)](A... a) -> R
+            {
+                return std::invoke(member_function, instance_pointer, std::forward<A>(a)...);
+            }) { }
+
+        // can be invoked
+        explicit operator bool() const noexcept
+        {
+            return static_cast<bool>(this->delegate_);
+        }
+
+        // invoke
+        R operator()(A... args) const
+        {
+            return this->delegate_(std::forward<A>(args)...);
+        }
+    };
+
+    template <typename T>
+    class shared_delegate;
+
+    /// shared delegate - shares one callable between copies.
+    /// The callable is placed in a heap block next to its reference count, so copying is one atomic increment.
+    /// Note: the callable is invoked concurrently if copies are invoked concurrently.
+    template <class R, class... A>
+    class shared_delegate<R(A...)>
+    {
+        struct block
+        {
+            std::atomic_size_t ref_count_{1};
+            R (*invoke_)(block*, A...){};
+            void (*destroy_)(block*) noexcept {};
+        };
+
+        template <class T>
+        struct block_for final : block
+        {
+            std::pmr::memory_resource* resource_;
+            T functor_;
+
+            template <class U>
+            block_for(std::pmr::memory_resource* resource, U&& functor) : resource_(resource), functor_(std::forward<U>(functor))
+            {
+                this->invoke_ = [](block* b, A... args) -> R { return static_cast<block_for*>(b)->functor_(std::forward<A>(args)...); };
+                this->destroy_ = [](block* b) noexcept
+                {
+                    auto* self = static_cast<block_for*>(b);
+                    auto* resource = self->resource_;
+                    self->~block_for();
+                    resource->deallocate(self, sizeof(block_for), alignof(block_for));
+                };
+            }
+        };
+
+        block* block_{};
+
+        template <class T>
+        void emplace(std::pmr::memory_resource* resource, T&& functor)
+        {
+            using U = block_for<std::remove_cv_t<std::remove_reference_t<T>>>;
+            void* p = resource->allocate(sizeof(U), alignof(U));
+            try { block_ = new(p) U(resource, std::forward<T>(functor)); }
+            catch (...)
+            {
+                resource->deallocate(p, sizeof(U), alignof(U));
+                throw;
+            }
+        }
+
+        void reset() noexcept
+        {
+            if (auto* b = std::exchange(block_, nullptr); b && b->ref_count_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                b->destroy_(b);
+        }
+
+    public:
+        // empty delegate
+        shared_delegate() = default;
+
+        // from nullptr (empty)
+        shared_delegate(std::nullptr_t) { }
+
+        // copy (shares the callable)
+        shared_delegate(const shared_delegate& other) noexcept : block_(other.block_)
+        {
+            if (block_) block_->ref_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // copy assign
+        shared_delegate& operator=(const shared_delegate& other) noexcept
+        {
+            shared_delegate tmp(other);
+            std::swap(block_, tmp.block_);
+            return *this;
+        }
+
+        // move
+        shared_delegate(shared_delegate&& other) noexcept : block_(std::exchange(other.block_, nullptr)) { }
+
+        // move assign
+        shared_delegate& operator=(shared_delegate&& other) noexcept
+        {
+            shared_delegate tmp(std::move(other));
+            std::swap(block_, tmp.block_);
+            return *this;
+        }
+
+        // destruct
+        ~shared_delegate()
+        {
+            this->reset();
+        }
+
+        // from function pointer
+        shared_delegate(R (*function_pointer)(A...)) { this->emplace(std::pmr::get_default_resource(), function_pointer); }
+
+        // from functor
+        template <class Functor, std::enable_if_t<
+                      std::is_class_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      !std::is_same_v<std::remove_cv_t<std::remove_reference_t<Functor>>, shared_delegate> &&
+                      std::is_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>, Functor> &&
+                      std::is_invocable_r_v<R, Functor, A...>
+                  >* = nullptr>
+        shared_delegate(Functor&& functor)
+        {
+            this->emplace(std::pmr::get_default_resource(), std::forward<Functor>(functor));
+        }
+
+        // from functor, allocates the block from `resource`
+        template <class Functor, std::enable_if_t<
+                      std::is_class_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      std::is_constructible_v<std::remove_cv_t<std::remove_reference_t<Functor>>, Functor> &&
+                      std::is_invocable_r_v<R, Functor, A...>
+                  >* = nullptr>
+        shared_delegate(std::allocator_arg_t, std::pmr::memory_resource* resource, Functor&& functor)
+        {
+            this->emplace(resource, std::forward<Functor>(functor));
+        }
+
+        // from member-function-pointer-like type with binding instance-pointer-like type
+        template <class P, class F, std::enable_if_t<
+                      std::is_constructible_v<std::remove_const_t<std::remove_reference_t<P>>, P> &&
+                      std::is_constructible_v<std::remove_const_t<std::remove_reference_t<F>>, F> &&
+                      std::is_invocable_r_v<R, F, P, A...>
+                  >* = nullptr>
+        shared_delegate(P&& instance_pointer, F&& member_function)
+            : shared_delegate([instance_pointer = std::forward<P>(instance_pointer), member_function = std::forward<F>(member_function)](A... a) -> R
+            {
+                return std::invoke(member_function, instance_pointer, std::forward<A>(a)...);
+            }) { }
+
+        // the number of copies sharing the callable
+        [[nodiscard]] size_t use_count() const noexcept
+        {
+            return block_ ? block_->ref_count_.load(std::memory_order_relaxed) : 0;
+        }
+
+        // can be invoked
+        explicit operator bool() const noexcept
+        {
+            return this->block_;
+        }
+
+        // invoke
+        R operator()(A... args) const
+        {
+            if (this->block_) return this->block_->invoke_(this->block_, std::forward<A>(args)...);
+            else throw std::bad_function_call();
+        }
+    };
+
+    // CTAD guilds
+    // @formatter:off
+    template <class R, class... A> copyable_delegate(R (*)(A...)) -> copyable_delegate<R(A...)>;
+    template <class P, class F> copyable_delegate(P&&, F&&) -> copyable_delegate<typename delegate_detail::function_type_deduction<std::remove_reference_t<F>>::type>;
+    template <class F> copyable_delegate(F&&) -> copyable_delegate<typename delegate_detail::function_type_deduction<decltype(&std::remove_reference_t<F>::operator())>::type>;
+
+    template <class R, class... A> shared_delegate(R (*)(A...)) -> shared_delegate<R(A...)>;
+    template <class P, class F> shared_delegate(P&&, F&&) -> shared_delegate<typename delegate_detail::function_type_deduction<std::remove_reference_t<F>>::type>;
+    template <class F> shared_delegate(F&&) -> shared_delegate<typename delegate_detail::function_type_deduction<decltype(&std::remove_reference_t<F>::operator())>::type>;
+    // @formatter:on
+
 #if 0 // type deduction guide test
     namespace delegate_detail::deduction_test
     {
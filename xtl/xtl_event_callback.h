@@ -5,35 +5,207 @@
 
 #pragma once
 
+#include <cstdint>
+#include <limits>
 #include <mutex>
+#include <memory>
+#include <atomic>
+#include <vector>
 #include <utility>
-#include <functional>
 #include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "xtl_delegate.h"
 
 namespace xtl
 {
     template <class F> class event_callback;
 
+    /// Thread-safe event callback list.
+    /// The subscriber list is an immutable snapshot that is replaced on subscribe/unsubscribe (copy-on-write),
+    /// so `raise` does not take the lock while callbacks are running.
+    /// `raise` is lock-free: it pins the snapshot by a reader counter of the current epoch (two atomic adds),
+    /// and replaced snapshots are reclaimed after the readers of their epoch have left.
+    /// Callbacks may subscribe/unsubscribe from inside `raise`; the change takes effect from the next `raise`.
+    /// Callbacks are stored by value in the snapshot, so copy constructible callbacks are copied into each new snapshot
+    /// (move-only ones are shared between snapshots by one heap block).
+    /// Note: the same callback may be invoked concurrently if `raise` is called from multiple threads.
     template <class...TArgs>
     class event_callback<void(TArgs ...)> final
     {
     public:
         using subscribe_id = const void*;
         using mutex = std::mutex;
-        using callback = std::function<void(TArgs ...)>;
+        using callback = delegate<void(TArgs ...)>;
 
     private:
-        mutable mutex mutex_{};
+        mutable mutex mutex_{}; // serializes writers
+
+        using stored_callback = copyable_delegate<void(TArgs ...)>;
 
         struct entry
         {
+            stored_callback callback_{};
             subscribe_id id_{};
-            callback callback_{};
             int priority_{};
-            std::unique_ptr<std::byte> idu_{};
         };
 
-        std::vector<entry> functions_{};
+        // sorted by priority.
+        struct snapshot
+        {
+            std::vector<entry> entries{};
+            snapshot* next_retired{};
+        };
+
+        std::atomic<snapshot*> functions_{}; // nullptr if empty
+
+        // deferred reclamation (lists are guarded by mutex_).
+        // snapshots replaced in the current epoch are `retired_`, and ones replaced in the previous epoch are `retiring_`.
+        // the epoch is flipped only when no reader of the previous epoch remains, then `retiring_` is deleted.
+        mutable std::atomic<unsigned> epoch_{};
+        mutable std::atomic<size_t> readers_[2]{};
+        mutable std::atomic<bool> reclaim_pending_{};
+        mutable snapshot* retired_{};
+        mutable snapshot* retiring_{};
+
+        // the next minted subscribe_id (guarded by mutex_), odd so that it never equals an aligned user pointer.
+        uintptr_t next_id_ = 1;
+
+        /// Pins the current snapshot while alive.
+        class read_guard final
+        {
+            const event_callback* owner_;
+            unsigned epoch_;
+            const snapshot* snapshot_;
+
+        public:
+            explicit read_guard(const event_callback* owner) noexcept
+                : owner_(owner)
+                , epoch_(owner->epoch_.load(std::memory_order_seq_cst))
+            {
+                owner_->readers_[epoch_].fetch_add(1, std::memory_order_seq_cst);
+                snapshot_ = owner_->functions_.load(std::memory_order_seq_cst);
+            }
+
+            read_guard(const read_guard& other) = delete;
+            read_guard(read_guard&& other) noexcept = delete;
+            read_guard& operator=(const read_guard& other) = delete;
+            read_guard& operator=(read_guard&& other) noexcept = delete;
+
+            ~read_guard()
+            {
+                // the last reader of the epoch reclaims if a writer has left garbage.
+                if (owner_->readers_[epoch_].fetch_sub(1, std::memory_order_seq_cst) == 1 &&
+                    owner_->reclaim_pending_.load(std::memory_order_seq_cst))
+                    owner_->try_reclaim();
+            }
+
+            [[nodiscard]] const snapshot* get() const noexcept { return snapshot_; }
+        };
+
+        static void delete_list(snapshot* list) noexcept
+        {
+            while (list) delete std::exchange(list, list->next_retired);
+        }
+
+        // flips the epoch and collects reclaimable snapshots (mutex_ held).
+        // returns the list to be deleted after unlock (callback destructors may call this object).
+        [[nodiscard]] snapshot* reclaim() const noexcept
+        {
+            reclaim_pending_.store(true, std::memory_order_seq_cst);
+
+            snapshot* garbage{};
+            for (;;)
+            {
+                const unsigned e = epoch_.load(std::memory_order_relaxed);
+                if (readers_[e ^ 1].load(std::memory_order_seq_cst) != 0) break; // readers of the previous epoch remain.
+
+                if (retiring_)
+                {
+                    snapshot* last = retiring_;
+                    while (last->next_retired) last = last->next_retired;
+                    last->next_retired = garbage;
+                    garbage = std::exchange(retiring_, nullptr);
+                }
+
+                if (!retired_) break;
+                retiring_ = std::exchange(retired_, nullptr);
+                epoch_.store(e ^ 1, std::memory_order_seq_cst);
+            }
+
+            reclaim_pending_.store(retired_ || retiring_, std::memory_order_seq_cst);
+            return garbage;
+        }
+
+        void try_reclaim() const noexcept
+        {
+            snapshot* garbage{};
+            {
+                std::unique_lock lock(mutex_, std::try_to_lock);
+                if (!lock) return; // the writer reclaims.
+                garbage = reclaim();
+            }
+            delete_list(garbage);
+        }
+
+        // replaces the snapshot (mutex_ held), returns garbage to be deleted after unlock.
+        [[nodiscard]] snapshot* publish(snapshot* s) noexcept
+        {
+            if (snapshot* old = functions_.exchange(s, std::memory_order_seq_cst))
+            {
+                old->next_retired = retired_;
+                retired_ = old;
+            }
+            return reclaim();
+        }
+
+        template <class F>
+        [[nodiscard]] static stored_callback make_stored(F&& f)
+        {
+            if constexpr (std::is_constructible_v<stored_callback, F>)
+            {
+                return stored_callback(std::forward<F>(f));
+            }
+            else
+            {
+                // move-only callable (including `callback`): shared by snapshots.
+                return stored_callback([p = std::make_shared<std::decay_t<F>>(std::forward<F>(f))](TArgs... args) { (*p)(std::forward<TArgs>(args)...); });
+            }
+        }
+
+        // mints new subscribe_id, which is committed by commit_id.
+        [[nodiscard]] subscribe_id mint_id() const
+        {
+            if (next_id_ == std::numeric_limits<uintptr_t>::max()) throw std::length_error("too many subscriptions");
+            return reinterpret_cast<subscribe_id>(next_id_);
+        }
+
+        void commit_id() noexcept
+        {
+            next_id_ += 2;
+        }
+
+        // builds the snapshot with the new entry (mutex_ held).
+        template <class F>
+        [[nodiscard]] std::unique_ptr<snapshot> insert(subscribe_id id, F&& f, int priority) const
+        {
+            auto s = std::make_unique<snapshot>();
+            if (const snapshot* current = functions_.load(std::memory_order_relaxed))
+            {
+                const auto& entries = current->entries;
+                s->entries.reserve(entries.size() + 1);
+                auto pos = std::upper_bound(entries.begin(), entries.end(), priority, [](int p, const entry& x) { return p < x.priority_; });
+                s->entries.insert(s->entries.end(), entries.begin(), pos);
+                s->entries.push_back(entry{make_stored(std::forward<F>(f)), id, priority});
+                s->entries.insert(s->entries.end(), pos, entries.end());
+            }
+            else
+            {
+                s->entries.push_back(entry{make_stored(std::forward<F>(f)), id, priority});
+            }
+            return s;
+        }
 
     public:
         event_callback() = default;
@@ -41,76 +213,113 @@ namespace xtl
         event_callback(event_callback&& other) noexcept = delete;
         event_callback& operator=(const event_callback& other) = delete;
         event_callback& operator=(event_callback&& other) noexcept = delete;
-        ~event_callback() = default;
+        ~event_callback()
+        {
+            delete_list(functions_.load(std::memory_order_relaxed));
+            delete_list(retired_);
+            delete_list(retiring_);
+        }
 
         [[nodiscard]] size_t count() const noexcept
         {
-            std::lock_guard lock(mutex_);
-            return functions_.size();
+            const read_guard guard(this);
+            return guard.get() ? guard.get()->entries.size() : 0;
         }
 
         [[nodiscard]] bool empty() const noexcept
         {
-            std::lock_guard lock(mutex_);
-            return functions_.empty();
+            return count() == 0;
         }
 
         void unsubscribe_all() noexcept
         {
-            std::lock_guard lock(mutex_);
-            return functions_.clear();
+            snapshot* garbage{};
+            {
+                std::lock_guard lock(mutex_);
+                garbage = publish(nullptr);
+            }
+            delete_list(garbage);
         }
 
-        subscribe_id subscribe(callback f, int priority = 0)
+        /// Subscribes the callback, and returns new subscribe_id.
+        template <class F, std::enable_if_t<std::is_invocable_v<F&, TArgs...>>* = nullptr>
+        subscribe_id subscribe(F&& f, int priority = 0)
         {
-            auto p = std::make_unique<std::byte>(); // assign new subscribe_id
-            auto id = p.get();
-
-            std::lock_guard lock(mutex_);
-            functions_.emplace_back(entry{id, std::move(f), priority, std::move(p)});
-            std::stable_sort(functions_.begin(), functions_.end(), [](auto&& a, auto&& b) { return a.priority_ < b.priority_; });
+            snapshot* garbage{};
+            subscribe_id id{};
+            {
+                std::lock_guard lock(mutex_);
+                id = mint_id();
+                auto s = insert(id, std::forward<F>(f), priority);
+                commit_id();
+                garbage = publish(s.release());
+            }
+            delete_list(garbage);
             return id;
         }
 
-        void subscribe(subscribe_id id, callback f, int priority = 0)
+        /// Subscribes the callback with user specified id (e.g. the pointer of the subscriber).
+        template <class F, std::enable_if_t<std::is_invocable_v<F&, TArgs...>>* = nullptr>
+        void subscribe(subscribe_id id, F&& f, int priority = 0)
         {
-            std::lock_guard lock(mutex_);
-            functions_.emplace_back(entry{id, std::move(f), priority, nullptr});
-            std::stable_sort(functions_.begin(), functions_.end(), [](auto&& a, auto&& b) { return a.priority_ < b.priority_; });
+            snapshot* garbage{};
+            {
+                std::lock_guard lock(mutex_);
+                auto s = insert(id, std::forward<F>(f), priority);
+                garbage = publish(s.release());
+            }
+            delete_list(garbage);
         }
 
+        /// Unsubscribes the first callback with the id.
+        /// O(n): the replacement snapshot is copied.
         bool unsubscribe(subscribe_id id)
         {
-            std::lock_guard lock(mutex_);
-            for (auto it = functions_.begin(); it != functions_.end(); ++it)
+            snapshot* garbage{};
             {
-                if (it->id_ == id)
+                std::lock_guard lock(mutex_);
+                const snapshot* current = functions_.load(std::memory_order_relaxed);
+                if (!current) return false;
+
+                const auto& entries = current->entries;
+                auto it = std::find_if(entries.begin(), entries.end(), [id](const entry& e) { return e.id_ == id; });
+                if (it == entries.end()) return false;
+
+                std::unique_ptr<snapshot> s;
+                if (entries.size() > 1)
                 {
-                    functions_.erase(it);
-                    return true;
+                    s = std::make_unique<snapshot>();
+                    s->entries.reserve(entries.size() - 1);
+                    s->entries.insert(s->entries.end(), entries.begin(), it);
+                    s->entries.insert(s->entries.end(), std::next(it), entries.end());
                 }
+
+                garbage = publish(s.release());
             }
-            return false;
+            delete_list(garbage);
+            return true;
         }
 
         template <class...Args>
         void raise(Args&&...params) const
         {
-            std::lock_guard lock(mutex_);
-            if (functions_.empty())
+            // pins the snapshot while invoking, unsubscribed callbacks are kept alive until return.
+            const read_guard guard(this);
+            const snapshot* functions = guard.get();
+            if (!functions)
             {
                 // do nothing
             }
-            else if (functions_.size() == 1)
+            else if (functions->entries.size() == 1)
             {
                 // can use move semantic.
-                functions_.front().callback_(std::forward<Args>(params)...);
+                functions->entries.front().callback_(std::forward<Args>(params)...);
             }
             else
             {
                 // can't use move semantic.
-                for (auto& f : functions_) f.callback_(params...);
+                for (const entry& f : functions->entries) f.callback_(params...);
             }
         }
     };
-}
+}
\ No newline at end of file
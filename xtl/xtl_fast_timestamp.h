@@ -0,0 +1,268 @@
+/// @file
+/// @brief  xtl::fast_timestamp - TSC-based low-overhead timestamp
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+
+#include "xtl_timestamp.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define XTL_FAST_TIMESTAMP_HAS_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#else
+#define XTL_FAST_TIMESTAMP_HAS_TSC 0
+#endif
+
+namespace xtl
+{
+    namespace fast_timestamp_detail
+    {
+        /// Checks the invariant TSC (constant rate in all ACPI P-, C- and T-states) by CPUID.80000007H:EDX[8].
+        [[nodiscard]] inline bool has_invariant_tsc() noexcept
+        {
+#if XTL_FAST_TIMESTAMP_HAS_TSC
+#if defined(_MSC_VER)
+            int r[4]{};
+            __cpuid(r, static_cast<int>(0x80000000));
+            if (static_cast<unsigned>(r[0]) < 0x80000007) return false;
+            __cpuid(r, static_cast<int>(0x80000007));
+            return (r[3] & (1 << 8)) != 0;
+#else
+            unsigned int eax{}, ebx{}, ecx{}, edx{};
+            if (__get_cpuid_max(0x80000000, nullptr) < 0x80000007) return false;
+            if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx)) return false;
+            return (edx & (1u << 8)) != 0;
+#endif
+#else
+            return false;
+#endif
+        }
+
+        [[nodiscard]] inline uint64_t read_tsc() noexcept
+        {
+#if XTL_FAST_TIMESTAMP_HAS_TSC
+            return __rdtsc();
+#else
+            return 0;
+#endif
+        }
+
+        /// TSC to timestamp conversion, calibrated against timestamp::now().
+        /// The rate is measured over the whole time since the first calibration, and is refined
+        /// when a conversion finds the last calibration older than recalibration_interval.
+        /// A recalibration continues from the current conversion and slews the error out over the next interval
+        /// (the measured rate is used beyond it), so converted timestamps do not jump (or go backwards) by the error of the previous calibration.
+        /// After an idle gap, when nothing past the slewed interval has been converted, it re-anchors to the sample instead.
+        /// Parameters are published by a seqlock so that conversions do not block each other.
+        class tsc_calibration final
+        {
+            static constexpr inline timestamp::value_type initial_calibration_ticks = timestamp::ticks_per_second / 500; // 2ms
+            static constexpr inline timestamp::value_type recalibration_interval_ticks = timestamp::ticks_per_second;    // 1s
+
+            std::atomic<uint32_t> sequence_{}; // odd while updating
+
+            // the first sample
+            uint64_t origin_tsc_{};
+            timestamp::value_type origin_tick_{};
+
+            // the conversion: base_tick + (tsc - base_tsc) * slew_ticks_per_tsc within the interval, and ticks_per_tsc beyond it
+            std::atomic<uint64_t> base_tsc_{};
+            std::atomic<timestamp::value_type> base_tick_{};
+            std::atomic<double> slew_ticks_per_tsc_{};
+
+            // the measured rate
+            std::atomic<double> ticks_per_tsc_{};
+            std::atomic<uint64_t> recalibration_interval_tsc_{};
+
+            struct sample
+            {
+                uint64_t tsc;
+                timestamp::value_type tick;
+            };
+
+            [[nodiscard]] static sample take_sample() noexcept
+            {
+                const uint64_t t0 = read_tsc();
+                const timestamp now = timestamp::now();
+                const uint64_t t1 = read_tsc();
+                return sample{t0 + (t1 - t0) / 2, now.tick};
+            }
+
+            [[nodiscard]] timestamp::value_type convert(uint64_t tsc) const noexcept
+            {
+                const auto elapsed = static_cast<double>(static_cast<int64_t>(tsc - base_tsc_.load(std::memory_order_relaxed)));
+                const auto interval = static_cast<double>(recalibration_interval_tsc_.load(std::memory_order_relaxed));
+                const double slew_ticks_per_tsc = slew_ticks_per_tsc_.load(std::memory_order_relaxed);
+
+                const double ticks = elapsed <= interval
+                                         ? elapsed * slew_ticks_per_tsc
+                                         : interval * slew_ticks_per_tsc + (elapsed - interval) * ticks_per_tsc_.load(std::memory_order_relaxed);
+
+                return base_tick_.load(std::memory_order_relaxed) + static_cast<timestamp::value_type>(ticks);
+            }
+
+            // measures the rate from the origin to `s`, and converts from (s.tsc, base_tick).
+            void store(sample s, timestamp::value_type base_tick) noexcept
+            {
+                const double ticks_per_tsc = static_cast<double>(s.tick - origin_tick_) / static_cast<double>(s.tsc - origin_tsc_);
+                const double interval_tsc = static_cast<double>(recalibration_interval_ticks) / ticks_per_tsc;
+
+                // slews base_tick toward s.tick by the end of the next interval, at most half the rate.
+                const double correction = std::clamp(static_cast<double>(s.tick - base_tick) / interval_tsc, -ticks_per_tsc / 2, ticks_per_tsc / 2);
+
+                base_tsc_.store(s.tsc, std::memory_order_relaxed);
+                base_tick_.store(base_tick, std::memory_order_relaxed);
+                slew_ticks_per_tsc_.store(ticks_per_tsc + correction, std::memory_order_relaxed);
+                ticks_per_tsc_.store(ticks_per_tsc, std::memory_order_relaxed);
+                recalibration_interval_tsc_.store(static_cast<uint64_t>(interval_tsc), std::memory_order_relaxed);
+            }
+
+            void recalibrate(uint32_t sequence) noexcept
+            {
+                if (!sequence_.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                    return; // another thread is recalibrating.
+
+                std::atomic_thread_fence(std::memory_order_release);
+                const sample s = take_sample();
+
+                // conversions past the interval trigger a recalibration, so if the sample is beyond two intervals,
+                // nothing after the first interval has been converted and re-anchoring does not go backwards.
+                const uint64_t elapsed = s.tsc - base_tsc_.load(std::memory_order_relaxed);
+                const bool idle = elapsed > 2 * recalibration_interval_tsc_.load(std::memory_order_relaxed);
+                store(s, idle ? s.tick : convert(s.tsc)); // otherwise, continues from the current conversion
+                sequence_.store(sequence + 2, std::memory_order_release);
+            }
+
+        public:
+            tsc_calibration() noexcept
+            {
+                const sample origin = take_sample();
+                origin_tsc_ = origin.tsc;
+                origin_tick_ = origin.tick;
+
+                sample s = take_sample();
+                while (s.tick - origin_tick_ < initial_calibration_ticks || s.tsc == origin_tsc_)
+                    s = take_sample();
+
+                store(s, s.tick);
+            }
+
+            tsc_calibration(const tsc_calibration& other) = delete;
+            tsc_calibration(tsc_calibration&& other) noexcept = delete;
+            tsc_calibration& operator=(const tsc_calibration& other) = delete;
+            tsc_calibration& operator=(tsc_calibration&& other) noexcept = delete;
+            ~tsc_calibration() = default;
+
+            [[nodiscard]] static tsc_calibration& instance() noexcept
+            {
+                static tsc_calibration calibration;
+                return calibration;
+            }
+
+            [[nodiscard]] double ticks_per_tsc() const noexcept
+            {
+                return ticks_per_tsc_.load(std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] timestamp to_timestamp(uint64_t tsc) noexcept
+            {
+                for (;;)
+                {
+                    const uint32_t s0 = sequence_.load(std::memory_order_acquire);
+                    if (s0 & 1) continue; // updating
+
+                    const uint64_t base_tsc = base_tsc_.load(std::memory_order_relaxed);
+                    const uint64_t interval = recalibration_interval_tsc_.load(std::memory_order_relaxed);
+                    const timestamp::value_type tick = convert(tsc);
+
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (sequence_.load(std::memory_order_relaxed) != s0) continue; // updated
+
+                    const auto elapsed = static_cast<int64_t>(tsc - base_tsc);
+                    if (elapsed > 0 && static_cast<uint64_t>(elapsed) > interval)
+                    {
+                        recalibrate(s0);
+                        continue; // converts with the new parameters
+                    }
+
+                    return timestamp{tick};
+                }
+            }
+        };
+    }
+
+    /// Low-overhead timestamp for latency tracing.
+    /// now() reads the invariant TSC (a single rdtsc), and the conversion to `timestamp` is deferred to to_timestamp().
+    /// The TSC rate is calibrated against timestamp::now() on the first use (takes a few milliseconds, call calibrate() at startup),
+    /// and is recalibrated for drift by conversions at least once a second.
+    /// On hosts without an invariant TSC, it falls back to timestamp::now().
+    struct fast_timestamp
+    {
+        using value_type = uint64_t;
+
+        /// TSC count, or timestamp::tick on hosts without an invariant TSC.
+        value_type value;
+
+        /// Checks whether the invariant TSC is used.
+        [[nodiscard]] static inline bool uses_tsc() noexcept
+        {
+            static const bool invariant_tsc = fast_timestamp_detail::has_invariant_tsc();
+            return invariant_tsc;
+        }
+
+        /// Calibrates the TSC rate if not yet.
+        static inline void calibrate() noexcept
+        {
+            if (uses_tsc())
+                static_cast<void>(fast_timestamp_detail::tsc_calibration::instance());
+        }
+
+        [[nodiscard]] static inline fast_timestamp now() noexcept
+        {
+            if (uses_tsc())
+                return fast_timestamp{fast_timestamp_detail::read_tsc()};
+
+            return fast_timestamp{static_cast<value_type>(timestamp::now().tick)};
+        }
+
+        [[nodiscard]] timestamp to_timestamp() const noexcept
+        {
+            if (uses_tsc())
+                return fast_timestamp_detail::tsc_calibration::instance().to_timestamp(value);
+
+            return timestamp{static_cast<timestamp::value_type>(value)};
+        }
+
+        /// Gets elapsed time from `since` in timestamp ticks.
+        [[nodiscard]] double ticks_since(fast_timestamp since) const noexcept
+        {
+            const auto elapsed = static_cast<double>(static_cast<int64_t>(value - since.value));
+            if (uses_tsc())
+                return elapsed * fast_timestamp_detail::tsc_calibration::instance().ticks_per_tsc();
+
+            return elapsed;
+        }
+
+        bool operator ==(fast_timestamp rhs) const { return value == rhs.value; }
+        bool operator !=(fast_timestamp rhs) const { return value != rhs.value; }
+        bool operator <(fast_timestamp rhs) const { return value < rhs.value; }
+        bool operator >(fast_timestamp rhs) const { return value > rhs.value; }
+        bool operator <=(fast_timestamp rhs) const { return value <= rhs.value; }
+        bool operator >=(fast_timestamp rhs) const { return value >= rhs.value; }
+    };
+
+    static_assert(std::is_standard_layout_v<fast_timestamp>);
+    static_assert(std::is_trivial_v<fast_timestamp>);
+    static_assert(sizeof(fast_timestamp) == sizeof(uint64_t));
+}
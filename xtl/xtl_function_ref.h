@@ -0,0 +1,93 @@
+/// @file
+/// @brief  xtl function_ref - a non-owning reference to a callable.
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <memory>
+#include <functional>
+
+#include "xtl_delegate.h"
+
+namespace xtl
+{
+    template <typename T>
+    class function_ref;
+
+    /// Non-owning reference to a callable (function_ref, C++26).
+    /// Consists of two pointers (object pointer + thunk), trivially copyable.
+    /// The referenced callable must outlive the function_ref, so use it for parameters invoked only during the call.
+    template <class R, class... A>
+    class function_ref<R(A...)> final
+    {
+        union storage
+        {
+            void* object;
+            void (*function)();
+        };
+
+        using thunk_function = R(*)(storage, A...);
+
+        storage storage_;
+        thunk_function thunk_;
+
+    public:
+        // from function pointer
+        function_ref(R (*function_pointer)(A...)) noexcept
+            : storage_{}
+            , thunk_([](storage s, A... args) -> R
+            {
+                return reinterpret_cast<R(*)(A...)>(s.function)(std::forward<A>(args)...);
+            })
+        {
+            storage_.function = reinterpret_cast<void(*)()>(function_pointer);
+        }
+
+#if defined(_MSC_VER) && defined(_M_IX86)
+        function_ref(R(__stdcall* function_pointer)(A...)) noexcept
+            : storage_{}
+            , thunk_([](storage s, A... args) -> R { return reinterpret_cast<R(__stdcall*)(A...)>(s.function)(std::forward<A>(args)...); })
+        {
+            storage_.function = reinterpret_cast<void(*)()>(function_pointer);
+        }
+#endif
+
+        // from functor (referenced, not copied)
+        template <class Functor, std::enable_if_t<
+                      std::is_class_v<std::remove_cv_t<std::remove_reference_t<Functor>>> &&
+                      !std::is_same_v<std::remove_cv_t<std::remove_reference_t<Functor>>, function_ref> &&
+                      std::is_invocable_r_v<R, std::remove_reference_t<Functor>&, A...>
+                  >* = nullptr>
+        function_ref(Functor&& functor) noexcept
+            : storage_{}
+            , thunk_([](storage s, A... args) -> R
+            {
+                return std::invoke(*static_cast<std::remove_reference_t<Functor>*>(s.object), std::forward<A>(args)...);
+            })
+        {
+            storage_.object = const_cast<void*>(static_cast<const void*>(std::addressof(functor)));
+        }
+
+        function_ref(const function_ref&) noexcept = default;
+        function_ref& operator=(const function_ref&) noexcept = default;
+        ~function_ref() = default;
+
+        // invoke
+        R operator()(A... args) const
+        {
+            return thunk_(storage_, std::forward<A>(args)...);
+        }
+    };
+
+    // CTAD guilds
+    // @formatter:off
+    template <         class R, class... A> function_ref(R (          *)(A...)) -> function_ref<R(A...)>;
+#if defined(_MSC_VER) && defined(_M_IX86)
+    template <         class R, class... A> function_ref(R (__stdcall *)(A...)) -> function_ref<R(A...)>;
+#endif
+    template <class F> function_ref(F&&) -> function_ref<typename delegate_detail::function_type_deduction<decltype(&std::remove_reference_t<F>::operator())>::type>;
+    // @formatter:on
+}
\ No newline at end of file
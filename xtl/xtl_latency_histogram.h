@@ -0,0 +1,258 @@
+/// @file
+/// @brief  xtl::latency_histogram - HDR-style log-linear histogram and scoped_timer
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "xtl_timestamp.h"
+
+namespace xtl
+{
+    namespace latency_histogram_detail
+    {
+        /// Gets the index of the most significant set bit (value must not be 0).
+        [[nodiscard]] inline unsigned most_significant_bit(uint64_t value) noexcept
+        {
+#if defined(_MSC_VER)
+            unsigned long index{};
+            _BitScanReverse64(&index, value);
+            return static_cast<unsigned>(index);
+#else
+            return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+        }
+
+        inline std::atomic<size_t> next_thread_slot{};
+
+        /// Per-thread slot to choose a shard.
+        [[nodiscard]] inline size_t thread_slot() noexcept
+        {
+            static thread_local const size_t slot = next_thread_slot.fetch_add(1, std::memory_order_relaxed);
+            return slot;
+        }
+    }
+
+    /// Log-linear histogram for latency measurement (like HdrHistogram).
+    /// Values below 2^(SubBucketBits+1) are recorded exactly, and larger ones with relative error below 2^-SubBucketBits.
+    /// Values of 2^ValueBits or larger are clamped.
+    /// Recording is lock-free and never allocates: each thread records to one of the fixed shards with relaxed atomic adds.
+    /// Shards are merged on read by get_snapshot().
+    /// Not movable (a moved-from one would have no shards to record to), share it by reference or by a smart pointer.
+    template <unsigned SubBucketBits = 5, unsigned ValueBits = 40>
+    class basic_latency_histogram final
+    {
+        static_assert(SubBucketBits >= 1 && SubBucketBits < ValueBits && ValueBits <= 63);
+
+    public:
+        static constexpr inline size_t sub_bucket_count = size_t{1} << SubBucketBits;
+        static constexpr inline size_t bucket_count = (ValueBits - SubBucketBits + 1) * sub_bucket_count;
+        static constexpr inline uint64_t max_value = (uint64_t{1} << ValueBits) - 1;
+
+        /// Gets the bucket index for the value.
+        [[nodiscard]] static size_t bucket_index(uint64_t value) noexcept
+        {
+            value = std::min(value, max_value);
+            if (value < 2 * sub_bucket_count) return static_cast<size_t>(value);
+
+            const unsigned shift = latency_histogram_detail::most_significant_bit(value) - SubBucketBits;
+            return (shift + 1) * sub_bucket_count + static_cast<size_t>((value >> shift) - sub_bucket_count);
+        }
+
+        /// Gets the lowest value in the bucket.
+        [[nodiscard]] static constexpr uint64_t bucket_lower_bound(size_t index) noexcept
+        {
+            if (index < 2 * sub_bucket_count) return index;
+
+            const size_t shift = index / sub_bucket_count - 1;
+            return static_cast<uint64_t>(index % sub_bucket_count + sub_bucket_count) << shift;
+        }
+
+        /// Gets the highest value in the bucket.
+        [[nodiscard]] static constexpr uint64_t bucket_upper_bound(size_t index) noexcept
+        {
+            return bucket_lower_bound(index + 1) - 1;
+        }
+
+        /// Merged counts.
+        class snapshot
+        {
+            std::vector<uint64_t> counts_ = std::vector<uint64_t>(bucket_count);
+            uint64_t total_count_{};
+
+            friend class basic_latency_histogram;
+
+        public:
+            [[nodiscard]] uint64_t count() const noexcept { return total_count_; }
+            [[nodiscard]] uint64_t count_at(size_t bucket) const noexcept { return counts_[bucket]; }
+
+            /// Gets the mean of the values, estimated from the middle of buckets.
+            [[nodiscard]] double mean() const noexcept
+            {
+                if (total_count_ == 0) return 0.0;
+
+                double sum = 0.0;
+                for (size_t i = 0; i < bucket_count; i++)
+                    if (counts_[i])
+                        sum += static_cast<double>(counts_[i]) * (static_cast<double>(bucket_lower_bound(i)) + static_cast<double>(bucket_upper_bound(i))) / 2;
+                return sum / static_cast<double>(total_count_);
+            }
+
+            /// Gets the value at the percentile (0 to 100), the highest value in the bucket where it falls.
+            [[nodiscard]] uint64_t percentile(double percent) const noexcept
+            {
+                if (total_count_ == 0) return 0;
+
+                const double p = std::clamp(percent, 0.0, 100.0);
+                const auto rank = std::max<uint64_t>(static_cast<uint64_t>(p / 100.0 * static_cast<double>(total_count_) + 0.5), 1);
+
+                uint64_t accumulated = 0;
+                for (size_t i = 0; i < bucket_count; i++)
+                    if ((accumulated += counts_[i]) >= rank)
+                        return std::min(bucket_upper_bound(i), max_value);
+
+                return max_value;
+            }
+
+            [[nodiscard]] uint64_t min() const noexcept
+            {
+                for (size_t i = 0; i < bucket_count; i++)
+                    if (counts_[i]) return bucket_lower_bound(i);
+                return 0;
+            }
+
+            [[nodiscard]] uint64_t max() const noexcept
+            {
+                for (size_t i = bucket_count; i-- > 0;)
+                    if (counts_[i]) return std::min(bucket_upper_bound(i), max_value);
+                return 0;
+            }
+
+            snapshot& merge(const snapshot& other) noexcept
+            {
+                for (size_t i = 0; i < bucket_count; i++) counts_[i] += other.counts_[i];
+                total_count_ += other.total_count_;
+                return *this;
+            }
+        };
+
+    private:
+        struct alignas(64) shard
+        {
+            std::atomic<uint64_t> counts[bucket_count]{};
+        };
+
+        size_t shard_count_{};
+        std::unique_ptr<shard[]> shards_{};
+
+    public:
+        explicit basic_latency_histogram(size_t shard_count = 16)
+            : shard_count_(std::max<size_t>(shard_count, 1))
+            , shards_(std::make_unique<shard[]>(shard_count_))
+        {
+        }
+
+        basic_latency_histogram(const basic_latency_histogram& other) = delete;
+        basic_latency_histogram(basic_latency_histogram&& other) noexcept = delete;
+        basic_latency_histogram& operator=(const basic_latency_histogram& other) = delete;
+        basic_latency_histogram& operator=(basic_latency_histogram&& other) noexcept = delete;
+        ~basic_latency_histogram() = default;
+
+        /// Records the value (a relaxed atomic add to the bucket in the shard of this thread).
+        void record(uint64_t value, uint64_t count = 1) noexcept
+        {
+            shard& s = shards_[latency_histogram_detail::thread_slot() % shard_count_];
+            s.counts[bucket_index(value)].fetch_add(count, std::memory_order_relaxed);
+        }
+
+        /// Adds the counts of the snapshot (e.g. from other histogram).
+        void merge(const snapshot& other) noexcept
+        {
+            shard& s = shards_[latency_histogram_detail::thread_slot() % shard_count_];
+            for (size_t i = 0; i < bucket_count; i++)
+                if (auto c = other.count_at(i))
+                    s.counts[i].fetch_add(c, std::memory_order_relaxed);
+        }
+
+        /// Merges the shards.
+        /// Concurrent recording may or may not be included.
+        [[nodiscard]] snapshot get_snapshot() const
+        {
+            snapshot r;
+            for (size_t k = 0; k < shard_count_; k++)
+            {
+                for (size_t i = 0; i < bucket_count; i++)
+                {
+                    const uint64_t c = shards_[k].counts[i].load(std::memory_order_relaxed);
+                    r.counts_[i] += c;
+                    r.total_count_ += c;
+                }
+            }
+            return r;
+        }
+
+        /// Clears the counts.
+        /// Concurrent recording may or may not be cleared.
+        void reset() noexcept
+        {
+            for (size_t k = 0; k < shard_count_; k++)
+            {
+                for (auto& c : shards_[k].counts) c.store(0, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    using latency_histogram = basic_latency_histogram<>;
+
+    /// Records elapsed timestamp ticks from the construction to the destruction into the histogram.
+    ///
+    /// usage:
+    /// <pre>
+    ///   {
+    ///     xtl::scoped_timer timer(histogram);
+    ///     ... // measured
+    ///   }
+    /// </pre>
+    template <class Histogram = latency_histogram>
+    class scoped_timer final
+    {
+        Histogram* histogram_;
+        timestamp start_;
+
+    public:
+        explicit scoped_timer(Histogram& histogram) noexcept : histogram_(&histogram), start_(timestamp::now()) { }
+        scoped_timer(const scoped_timer& other) = delete;
+        scoped_timer(scoped_timer&& other) noexcept = delete;
+        scoped_timer& operator=(const scoped_timer& other) = delete;
+        scoped_timer& operator=(scoped_timer&& other) noexcept = delete;
+        ~scoped_timer() { stop(); }
+
+        /// Gets elapsed ticks.
+        [[nodiscard]] timestamp::value_type elapsed() const noexcept { return timestamp::now().tick - start_.tick; }
+
+        /// Records elapsed ticks now, and does not on destruction.
+        void stop() noexcept
+        {
+            if (histogram_)
+            {
+                const auto e = elapsed();
+                histogram_->record(static_cast<uint64_t>(e > 0 ? e : 0));
+                histogram_ = nullptr;
+            }
+        }
+
+        /// Stops without recording.
+        void cancel() noexcept { histogram_ = nullptr; }
+    };
+}
@@ -9,11 +9,48 @@
 #include <functional>
 #include <variant>
 #include <future>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <type_traits>
 
 #include "xtl_delegate.h"
+#include "xtl_worker_thread_pool.h"
 
 namespace xtl
 {
+    namespace lazy_detail
+    {
+        /// A factory shared by a prefetch task and the lazy, run by whichever claims it first.
+        /// If the pool drops the task without running it, the lazy runs the factory on get().
+        template <class T>
+        struct prefetched_factory final
+        {
+            delegate<T()> factory;
+            std::promise<T> promise{};
+            std::future<T> future = promise.get_future();
+            std::atomic<bool> claimed{};
+
+            explicit prefetched_factory(delegate<T()> factory) : factory(std::move(factory)) { }
+
+            void run() noexcept
+            {
+                if (claimed.exchange(true, std::memory_order_acq_rel)) return; // run by the other side
+
+                try { promise.set_value(factory()); }
+                catch (...) { promise.set_exception(std::current_exception()); }
+            }
+
+            T get()
+            {
+                run();
+                return future.get();
+            }
+        };
+    }
+
     template <class T>
     struct lazy
     {
@@ -22,6 +59,7 @@ namespace xtl
         using factory_t = delegate<T()>;
 
         mutable std::variant<empty_t, value_t, factory_t, std::exception_ptr> instance;
+        bool prefetched{}; // the factory is a wait for the prefetch
 
         struct lazy_ctor_t
         {
@@ -51,6 +89,21 @@ namespace xtl
             return std::get_if<value_t>(&instance);
         }
 
+        /// Starts the factory on the pool ahead of the first use.
+        /// Then get() waits for the computation and returns its result, or rethrows its exception.
+        /// If the pool rejects or drops the task (shutting down), the factory runs inline on the first get() instead.
+        /// returns false if the factory is not started.
+        bool prefetch(worker_thread_pool& pool)
+        {
+            if (prefetched || !std::holds_alternative<factory_t>(instance))
+                return false;
+
+            auto shared = std::make_shared<lazy_detail::prefetched_factory<T>>(std::move(std::get<factory_t>(instance)));
+            instance = factory_t([shared] { return shared->get(); });
+            prefetched = pool.post([shared = std::move(shared)] { shared->run(); });
+            return prefetched;
+        }
+
         T& get()
         {
             if (auto pointer = try_get()) { return *pointer; }
@@ -71,4 +124,168 @@ namespace xtl
         const T& operator *() const { return get(); }
         const T* operator ->() const { return &get(); }
     };
+
+    /// Thread-safe lazy.
+    /// The factory is run only once, by the first caller. Concurrent callers wait for it to finish.
+    /// An exception thrown from the factory is cached and rethrown by every get().
+    /// Once initialized, try_get() is a single acquire load.
+    /// prefetch() starts the factory on a worker_thread_pool, and get() waits for it.
+    template <class T>
+    class concurrent_lazy final
+    {
+    public:
+        using empty_t = std::nullptr_t;
+        using value_t = T;
+        using factory_t = delegate<T()>;
+        using lazy_ctor_t = typename lazy<T>::lazy_ctor_t;
+        static constexpr inline lazy_ctor_t lazy_ctor = lazy<T>::lazy_ctor;
+
+    private:
+        enum struct state : int { pending, running, ready };
+
+        // written only by the thread which runs the factory until state_ becomes ready.
+        std::variant<empty_t, value_t, factory_t, std::exception_ptr> instance_;
+        std::atomic<value_t*> value_{}; // set on ready with a value
+        std::atomic<state> state_{state::ready};
+
+        std::mutex mutex_{};
+        std::condition_variable cv_{};
+
+        void publish()
+        {
+            // notifies under the lock: the destructor may run as soon as the lock is released.
+            std::lock_guard lock(mutex_);
+            value_.store(std::get_if<value_t>(&instance_), std::memory_order_release);
+            state_.store(state::ready, std::memory_order_release);
+            cv_.notify_all();
+        }
+
+        // requires state::running
+        void run() noexcept
+        {
+            factory_t factory = std::move(std::get<factory_t>(instance_));
+            try { instance_ = factory(); }
+            catch (...) { instance_ = std::current_exception(); }
+            publish();
+        }
+
+        // requires state::running, the factory has not been run.
+        void cancel_run()
+        {
+            // back to pending, the factory will run on the first get().
+            std::lock_guard lock(mutex_);
+            state_.store(state::pending, std::memory_order_release);
+            cv_.notify_all();
+        }
+
+        /// The prefetch task. Cancels the run if destroyed without being invoked
+        /// (the pool rejected it, or dropped it on shutdown), so waiters never block forever.
+        class prefetch_task final
+        {
+            concurrent_lazy* owner_{};
+
+        public:
+            explicit prefetch_task(concurrent_lazy* owner) noexcept : owner_(owner) { }
+
+            prefetch_task(const prefetch_task& other) = delete;
+            prefetch_task(prefetch_task&& other) noexcept : owner_(std::exchange(other.owner_, nullptr)) { }
+            prefetch_task& operator=(const prefetch_task& other) = delete;
+            prefetch_task& operator=(prefetch_task&& other) noexcept = delete;
+
+            ~prefetch_task()
+            {
+                if (owner_) owner_->cancel_run();
+            }
+
+            void operator()() noexcept
+            {
+                std::exchange(owner_, nullptr)->run();
+            }
+        };
+
+        void wait_not_running()
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return state_.load(std::memory_order_acquire) != state::running; });
+        }
+
+        // slow path: runs the factory or waits for the running one.
+        void initialize() noexcept
+        {
+            for (state s = state_.load(std::memory_order_acquire); s != state::ready; s = state_.load(std::memory_order_acquire))
+            {
+                if (s == state::pending && state_.compare_exchange_strong(s, state::running, std::memory_order_acquire, std::memory_order_acquire))
+                    return run();
+
+                wait_not_running();
+            }
+        }
+
+    public:
+        concurrent_lazy() = default;
+        concurrent_lazy(value_t value) : instance_(std::move(value)) { value_.store(std::get_if<value_t>(&instance_), std::memory_order_relaxed); }
+        concurrent_lazy(factory_t factory) : instance_(std::move(factory)), state_(state::pending) { }
+        concurrent_lazy(std::function<T()> factory) : concurrent_lazy(factory_t(std::move(factory))) { }
+        concurrent_lazy(std::future<T> future) : concurrent_lazy(factory_t([future = std::move(future)]() mutable { return future.get(); })) { }
+
+        /// Takes a callable returning T (e.g. a lambda) as the factory, which is otherwise ambiguous between factory_t and std::function.
+        template <class F, std::enable_if_t<
+                      std::is_invocable_r_v<T, F&> &&
+                      !std::is_same_v<std::decay_t<F>, value_t> &&
+                      !std::is_same_v<std::decay_t<F>, factory_t> &&
+                      !std::is_same_v<std::decay_t<F>, std::function<T()>>>* = nullptr>
+        concurrent_lazy(F&& factory) : concurrent_lazy(factory_t(std::forward<F>(factory))) { }
+
+        template <class... TArgs>
+        concurrent_lazy(lazy_ctor_t, TArgs... args) : concurrent_lazy(factory_t([tpl = std::make_tuple(std::move(args)...)]() mutable
+        {
+            return std::apply([](auto&&... arg) { return value_t(std::forward<decltype(arg)>(arg)...); }, std::move(tpl));
+        })) { }
+
+        concurrent_lazy(const concurrent_lazy& other) = delete;
+        concurrent_lazy(concurrent_lazy&& other) noexcept = delete;
+        concurrent_lazy& operator=(const concurrent_lazy& other) = delete;
+        concurrent_lazy& operator=(concurrent_lazy&& other) noexcept = delete;
+        ~concurrent_lazy() { wait_not_running(); } // a prefetch may be running
+
+        /// Starts the factory on the pool ahead of the first use.
+        /// If the value is being computed, get() waits for it.
+        /// If the pool rejects or drops the task (shutting down), the factory runs on the first get() instead.
+        /// returns false if the factory is already started or finished, or if the pool is shutting down.
+        bool prefetch(worker_thread_pool& pool)
+        {
+            state expected = state::pending;
+            if (!state_.compare_exchange_strong(expected, state::running, std::memory_order_acquire, std::memory_order_relaxed))
+                return false;
+
+            return pool.post(delegate<void()>(prefetch_task(this))); // a rejected task is destroyed, and cancels the run.
+        }
+
+        T* try_get() noexcept
+        {
+            if (auto pointer = value_.load(std::memory_order_acquire)) { return pointer; }
+            if (state_.load(std::memory_order_acquire) != state::ready) { initialize(); }
+            return value_.load(std::memory_order_acquire);
+        }
+
+        T& get()
+        {
+            if (auto pointer = try_get()) { return *pointer; }
+            if (std::holds_alternative<std::exception_ptr>(instance_)) { std::rethrow_exception(std::get<std::exception_ptr>(instance_)); }
+            throw std::runtime_error("invalid instance status!");
+        }
+
+        const T* try_get() const noexcept { return const_cast<concurrent_lazy*>(this)->try_get(); }
+        const T& get() const { return const_cast<concurrent_lazy*>(this)->get(); }
+
+        operator T&() { return get(); }
+        T& operator ()() { return get(); }
+        T& operator *() { return get(); }
+        T* operator ->() { return &get(); }
+
+        operator const T&() const { return get(); }
+        const T& operator ()() const { return get(); }
+        const T& operator *() const { return get(); }
+        const T* operator ->() const { return &get(); }
+    };
 }
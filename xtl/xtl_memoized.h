@@ -0,0 +1,220 @@
+/// @file
+/// @brief  xtl::memoized - a memoizing function cache (bounded, sharded LRU)
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <tuple>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <unordered_map>
+
+#include "xtl_delegate.h"
+#include "xtl_lazy.h"
+
+namespace xtl
+{
+    namespace memoized_detail
+    {
+        /// Hashes a tuple by combining std::hash of each element.
+        struct tuple_hash
+        {
+            template <class... T>
+            size_t operator()(const std::tuple<T...>& tuple) const noexcept
+            {
+                return std::apply([](const auto&... e)
+                {
+                    size_t seed = 0;
+                    ((seed ^= std::hash<std::decay_t<decltype(e)>>()(e) + 0x9e3779b9 + (seed << 6) + (seed >> 2)), ...);
+                    return seed;
+                }, tuple);
+            }
+        };
+    }
+
+    template <class F, class Hash = memoized_detail::tuple_hash, class KeyEqual = std::equal_to<>>
+    class memoized;
+
+    /// Memoizing function cache.
+    /// Results are kept in a bounded LRU cache, split into shards each of which has its own lock.
+    /// Concurrent misses on the same arguments share one computation (see `concurrent_lazy`),
+    /// and the result or the exception of the computation is cached.
+    /// The function may be called from multiple threads at once, and must not call itself with the same arguments.
+    template <class R, class... A, class Hash, class KeyEqual>
+    class memoized<R(A...), Hash, KeyEqual> final
+    {
+        static_assert(!std::is_void_v<R>, "memoized function must return a value.");
+
+    public:
+        using result_type = R;
+        using key_type = std::tuple<std::decay_t<A>...>;
+        using function_type = delegate<R(A...)>;
+
+        struct statistics
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+        };
+
+        struct fixed_t
+        {
+            constexpr explicit fixed_t() = default;
+        } static constexpr inline fixed = fixed_t{};
+
+    private:
+        using value_type = std::shared_ptr<concurrent_lazy<R>>;
+        using lru_list = std::list<std::pair<key_type, value_type>>; // most recently used first
+
+        struct alignas(64) shard
+        {
+            std::mutex mutex{};
+            lru_list list{};
+            std::unordered_map<key_type, typename lru_list::iterator, Hash, KeyEqual> index{};
+            uint64_t hits{};
+            uint64_t misses{};
+            uint64_t evictions{};
+        };
+
+        function_type function_{};
+        Hash hash_{};
+        size_t capacity_per_shard_{};
+        size_t shard_count_{};
+        std::unique_ptr<shard[]> shards_{};
+
+        // picks the shard by the high bits of the mixed hash (Fibonacci hashing),
+        // so that keys in a shard still differ in the low bits which select the buckets of its index.
+        [[nodiscard]] size_t shard_index(const key_type& key) const
+        {
+            const uint64_t mixed = static_cast<uint64_t>(hash_(key)) * 0x9E3779B97F4A7C15;
+            return static_cast<size_t>(((mixed >> 32) * shard_count_) >> 32);
+        }
+
+        [[nodiscard]] value_type find_or_insert(key_type&& key)
+        {
+            shard& s = shards_[shard_index(key)];
+            std::lock_guard lock(s.mutex);
+
+            if (auto it = s.index.find(key); it != s.index.end())
+            {
+                s.hits++;
+                s.list.splice(s.list.begin(), s.list, it->second);
+                return it->second->second;
+            }
+
+            s.misses++;
+            auto value = std::make_shared<concurrent_lazy<R>>(typename concurrent_lazy<R>::factory_t(
+                [this, key]() -> R { return std::apply(function_, key); }));
+
+            s.list.emplace_front(std::move(key), value);
+            try { s.index.emplace(s.list.front().first, s.list.begin()); }
+            catch (...)
+            {
+                s.list.pop_front();
+                throw;
+            }
+
+            while (s.list.size() > capacity_per_shard_)
+            {
+                s.index.erase(s.list.back().first);
+                s.list.pop_back(); // a computation in flight is kept alive by its callers.
+                s.evictions++;
+            }
+
+            return value;
+        }
+
+    public:
+        /// @param capacity The maximum number of cached results (split evenly between shards).
+        /// @param shard_count The number of shards.
+        explicit memoized(function_type function, size_t capacity = 1024, size_t shard_count = 16, Hash hash = Hash())
+            : function_(std::move(function))
+            , hash_(std::move(hash))
+            , capacity_per_shard_(std::max<size_t>((capacity + std::max<size_t>(shard_count, 1) - 1) / std::max<size_t>(shard_count, 1), 1))
+            , shard_count_(std::max<size_t>(shard_count, 1))
+            , shards_(std::make_unique<shard[]>(shard_count_))
+        {
+        }
+
+        /// Constructs memoized recursive function `f(self, args...)` where `self` is this memoized object (see `with_fixed`).
+        template <class F>
+        memoized(fixed_t, F f, size_t capacity = 1024, size_t shard_count = 16, Hash hash = Hash())
+            : memoized(function_type([this, f = std::move(f)](A... args) -> R { return f(*this, std::forward<A>(args)...); }), capacity, shard_count, std::move(hash))
+        {
+        }
+
+        memoized(const memoized& other) = delete;
+        memoized(memoized&& other) noexcept = delete;
+        memoized& operator=(const memoized& other) = delete;
+        memoized& operator=(memoized&& other) noexcept = delete;
+        ~memoized() = default;
+
+        /// Gets the cached result, or computes it.
+        /// Rethrows the exception if the computation has thrown.
+        R operator()(A... args)
+        {
+            value_type value = find_or_insert(key_type(std::forward<A>(args)...));
+            return value->get();
+        }
+
+        /// Clears the cached results (statistics are kept).
+        void clear()
+        {
+            for (size_t i = 0; i < shard_count_; i++)
+            {
+                std::lock_guard lock(shards_[i].mutex);
+                shards_[i].index.clear();
+                shards_[i].list.clear();
+            }
+        }
+
+        /// Gets the number of cached results.
+        [[nodiscard]] size_t size() const
+        {
+            size_t n = 0;
+            for (size_t i = 0; i < shard_count_; i++)
+            {
+                std::lock_guard lock(shards_[i].mutex);
+                n += shards_[i].list.size();
+            }
+            return n;
+        }
+
+        /// Gets hit/miss/eviction counters.
+        [[nodiscard]] statistics stats() const
+        {
+            statistics r{};
+            for (size_t i = 0; i < shard_count_; i++)
+            {
+                std::lock_guard lock(shards_[i].mutex);
+                r.hits += shards_[i].hits;
+                r.misses += shards_[i].misses;
+                r.evictions += shards_[i].evictions;
+            }
+            return r;
+        }
+    };
+
+    /// Memoizing version of `with_fixed`: wraps recursive lambda F by a fixed point combinator,
+    /// and recursive calls are memoized.
+    ///
+    /// usage:
+    /// <pre>
+    ///   auto fibonacci = xtl::with_fixed_memoized<uint64_t(int)>(
+    ///     [](auto& f, int x) -> uint64_t { return x < 2 ? x : f(x-2) + f(x-1); });
+    ///   auto fibonacci_of_90 = fibonacci(90);
+    /// </pre>
+    template <class Signature, class F>
+    [[nodiscard]] static inline auto with_fixed_memoized(F&& f, size_t capacity = 1024, size_t shard_count = 16)
+    {
+        return memoized<Signature>(memoized<Signature>::fixed, std::forward<F>(f), capacity, shard_count);
+    }
+}
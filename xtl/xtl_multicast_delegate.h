@@ -0,0 +1,127 @@
+/// @file
+/// @brief  xtl multicast_delegate - an invocation list of delegates.
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "xtl_delegate.h"
+
+namespace xtl
+{
+    template <typename T, size_t InlineSize = delegate_default_inline_size>
+    class multicast_delegate;
+
+    /// Invokes all targets in the order of addition.
+    /// Targets are stored contiguously in one array, each of them in its own inline buffer (or heap if too large).
+    /// Not thread-safe by design (see `event_callback` for thread-safe one),
+    /// and targets must not modify the multicast_delegate while it is being invoked.
+    template <class... A, size_t InlineSize>
+    class multicast_delegate<void(A...), InlineSize> final
+    {
+    public:
+        using delegate_type = delegate<void(A...), InlineSize>;
+
+        /// Identifies an added target (a distinct type, so that integers and function pointers are not taken as handles).
+        enum class handle : size_t { none = 0 };
+
+    private:
+        std::vector<delegate_type> targets_{};
+        std::vector<handle> handles_{}; // kept apart from targets_ so that invocation walks only callables.
+        handle last_handle_{};
+
+    public:
+        multicast_delegate() = default;
+        multicast_delegate(const multicast_delegate& other) = delete;
+        multicast_delegate(multicast_delegate&& other) noexcept = default;
+        multicast_delegate& operator=(const multicast_delegate& other) = delete;
+        multicast_delegate& operator=(multicast_delegate&& other) noexcept = default;
+        ~multicast_delegate() = default;
+
+        [[nodiscard]] size_t size() const noexcept { return targets_.size(); }
+        [[nodiscard]] bool empty() const noexcept { return targets_.empty(); }
+        explicit operator bool() const noexcept { return !targets_.empty(); }
+
+        void reserve(size_t capacity)
+        {
+            targets_.reserve(capacity);
+            handles_.reserve(capacity);
+        }
+
+        void clear() noexcept
+        {
+            targets_.clear();
+            handles_.clear();
+        }
+
+        /// Adds the target to the end of the invocation list.
+        /// returns the handle to remove it, or handle::none if the target is empty.
+        handle add(delegate_type target)
+        {
+            if (!target) { return handle::none; }
+            handles_.reserve(handles_.size() + 1);
+            targets_.push_back(std::move(target));
+            last_handle_ = static_cast<handle>(static_cast<size_t>(last_handle_) + 1);
+            handles_.push_back(last_handle_);
+            return last_handle_;
+        }
+
+        /// Removes the target added as the handle.
+        bool remove(handle h) noexcept
+        {
+            if (auto it = std::lower_bound(handles_.begin(), handles_.end(), h); it != handles_.end() && *it == h)
+            {
+                targets_.erase(targets_.begin() + (it - handles_.begin()));
+                handles_.erase(it);
+                return true;
+            }
+            return false;
+        }
+
+        /// Removes the last added target which is the function pointer.
+        bool remove(void (*function_pointer)(A...)) noexcept
+        {
+            for (size_t i = targets_.size(); i-- > 0;)
+            {
+                if (auto p = targets_[i].template target<void(*)(A...)>(); p && *p == function_pointer)
+                {
+                    targets_.erase(targets_.begin() + static_cast<ptrdiff_t>(i));
+                    handles_.erase(handles_.begin() + static_cast<ptrdiff_t>(i));
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        multicast_delegate& operator +=(delegate_type target)
+        {
+            this->add(std::move(target));
+            return *this;
+        }
+
+        multicast_delegate& operator -=(handle h) noexcept
+        {
+            this->remove(h);
+            return *this;
+        }
+
+        multicast_delegate& operator -=(void (*function_pointer)(A...)) noexcept
+        {
+            this->remove(function_pointer);
+            return *this;
+        }
+
+        /// Invokes all targets.
+        template <class...Args>
+        void operator()(Args&&... args) const
+        {
+            for (auto& target : targets_)
+                target(args...);
+        }
+    };
+}
\ No newline at end of file
@@ -7,8 +7,15 @@
 
 #include <functional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <streambuf>
 #include <ostream>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
 
 namespace xtl
 {
@@ -43,7 +50,7 @@ namespace xtl
 
         char_type buffer_[3072];
 
-        explicit basic_null_ostreambuf() { base_type::setp(buffer_, buffer_, buffer_ + std::size(buffer_) - 1); }
+        explicit basic_null_ostreambuf() { base_type::setp(buffer_, buffer_ + std::size(buffer_)); }
         basic_null_ostreambuf(const basic_null_ostreambuf& other) = delete;
         basic_null_ostreambuf(basic_null_ostreambuf&& other) noexcept = delete;
         basic_null_ostreambuf& operator=(const basic_null_ostreambuf& other) = delete;
@@ -52,13 +59,13 @@ namespace xtl
 
         int_type overflow(int_type c) override
         {
-            base_type::setp(buffer_, buffer_, buffer_ + std::size(buffer_) - 1);
+            base_type::setp(buffer_, buffer_ + std::size(buffer_));
             return traits_type::not_eof(c);
         }
 
         int sync() override
         {
-            base_type::setp(buffer_, buffer_, buffer_ + std::size(buffer_) - 1);
+            base_type::setp(buffer_, buffer_ + std::size(buffer_));
             return 0;
         }
     };
@@ -66,6 +73,14 @@ namespace xtl
     template <class char_type> using basic_null_ostream = basic_ostream_for_streambuf<char_type, basic_null_ostreambuf<char_type>>;
     using null_ostream = basic_null_ostream<char>;
 
+    /// Tag to construct callback_ostream with the sink which receives `std::basic_string_view` instead of null-terminated text.
+    struct string_view_sink_t
+    {
+        constexpr explicit string_view_sink_t() = default;
+    };
+
+    static constexpr inline string_view_sink_t string_view_sink = string_view_sink_t{};
+
     template <class T = char>
     class basic_callback_ostreambuf : public std::basic_streambuf<T>
     {
@@ -77,11 +92,17 @@ namespace xtl
         using pos_type = typename base_type::pos_type;
         using off_type = typename base_type::off_type;
         using callback_type = std::function<void(const char_type*)>;
+        using string_view_callback_type = std::function<void(std::basic_string_view<char_type>)>;
 
-        callback_type sink_;
+        callback_type sink_;                   // receives null-terminated text
+        string_view_callback_type view_sink_; // receives text with length (preferred if set)
         char_type buffer_[3072];
 
         explicit basic_callback_ostreambuf(callback_type sink) : sink_(std::move(sink)) { base_type::setp(buffer_, buffer_ + std::size(buffer_) - 1); }
+
+        /// Constructs with the sink which receives `std::basic_string_view<char_type>` (no null-termination and no rescan for the length).
+        explicit basic_callback_ostreambuf(string_view_sink_t, string_view_callback_type sink) : view_sink_(std::move(sink)) { base_type::setp(buffer_, buffer_ + std::size(buffer_) - 1); }
+
         basic_callback_ostreambuf(const basic_callback_ostreambuf& other) = delete;
         basic_callback_ostreambuf(basic_callback_ostreambuf&& other) noexcept = delete;
         basic_callback_ostreambuf& operator=(const basic_callback_ostreambuf& other) = delete;
@@ -108,8 +129,15 @@ namespace xtl
         {
             if (base_type::pbase() == base_type::pptr()) { return 0; }
 
-            *base_type::pptr() = traits_type::to_char_type('\0');
-            sink_(base_type::pbase());
+            if (view_sink_)
+            {
+                view_sink_(std::basic_string_view<char_type>(base_type::pbase(), static_cast<size_t>(base_type::pptr() - base_type::pbase())));
+            }
+            else
+            {
+                *base_type::pptr() = traits_type::to_char_type('\0');
+                sink_(base_type::pbase());
+            }
             base_type::pbump(static_cast<int>(base_type::pbase() - base_type::pptr()));
             return 0;
         }
@@ -125,18 +153,26 @@ namespace xtl
         buffer.reserve(prefix.size() + 1024);
         buffer.append(prefix);
 
-        return basic_callback_ostream<char_type>([callback_per_line = std::move(callback_per_line), buffer = std::move(buffer)](const char_type* text) mutable
+        return basic_callback_ostream<char_type>(string_view_sink, [callback_per_line = std::move(callback_per_line), buffer = std::move(buffer)](std::basic_string_view<char_type> text) mutable
         {
+            using traits_type = std::char_traits<char_type>;
             const size_t prefix_size = buffer.size();
 
-            while (auto c = *text++)
+            // appends each run up to a newline at once (traits_type::find is memchr for char).
+            while (!text.empty())
             {
-                buffer += c;
-                if (c == '\n')
+                const char_type* newline = traits_type::find(text.data(), text.size(), char_type('\n'));
+                if (!newline)
                 {
-                    callback_per_line(buffer.c_str());
-                    buffer.resize(prefix_size);
+                    buffer.append(text);
+                    break;
                 }
+
+                const size_t length = static_cast<size_t>(newline - text.data()) + 1;
+                buffer.append(text.data(), length);
+                callback_per_line(buffer.c_str());
+                buffer.resize(prefix_size);
+                text.remove_prefix(length);
             }
 
             if (buffer.size() != prefix_size)
@@ -147,4 +183,186 @@ namespace xtl
             }
         });
     }
+
+    /// streambuf which passes each completed line to the sink in one call.
+    /// A partial line is kept until its newline (or the destruction).
+    template <class T = char>
+    class basic_line_ostreambuf : public std::basic_streambuf<T>
+    {
+    public:
+        using base_type = std::basic_streambuf<T>;
+        using char_type = typename base_type::char_type;
+        using traits_type = typename base_type::traits_type;
+        using int_type = typename base_type::int_type;
+        using pos_type = typename base_type::pos_type;
+        using off_type = typename base_type::off_type;
+        using string_view_type = std::basic_string_view<char_type>;
+        using callback_type = std::function<void(string_view_type)>;
+
+        callback_type sink_;
+        std::basic_string<char_type> pending_; // partial line
+        char_type buffer_[1024];
+
+        explicit basic_line_ostreambuf(callback_type sink) : sink_(std::move(sink)) { base_type::setp(buffer_, buffer_ + std::size(buffer_)); }
+        basic_line_ostreambuf(const basic_line_ostreambuf& other) = delete;
+        basic_line_ostreambuf(basic_line_ostreambuf&& other) noexcept = delete;
+        basic_line_ostreambuf& operator=(const basic_line_ostreambuf& other) = delete;
+        basic_line_ostreambuf& operator=(basic_line_ostreambuf&& other) noexcept = delete;
+
+        ~basic_line_ostreambuf() override
+        {
+            basic_line_ostreambuf::sync();
+            if (!pending_.empty()) sink_(pending_);
+        }
+
+        int_type overflow(int_type c) override
+        {
+            sync();
+
+            if (c != traits_type::eof())
+            {
+                *base_type::pptr() = traits_type::to_char_type(c);
+                base_type::pbump(1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override
+        {
+            string_view_type text(base_type::pbase(), static_cast<size_t>(base_type::pptr() - base_type::pbase()));
+            while (const char_type* newline = traits_type::find(text.data(), text.size(), char_type('\n')))
+            {
+                const size_t length = static_cast<size_t>(newline - text.data()) + 1;
+                if (pending_.empty())
+                {
+                    sink_(text.substr(0, length));
+                }
+                else
+                {
+                    pending_.append(text.data(), length);
+                    sink_(pending_);
+                    pending_.clear();
+                }
+                text.remove_prefix(length);
+            }
+
+            pending_.append(text);
+            base_type::setp(buffer_, buffer_ + std::size(buffer_));
+            return 0;
+        }
+    };
+
+    /// Thread-safe ostream facade which formats into a thread-local buffer without locking,
+    /// and passes each completed line to the shared sink in one call (like C++20 std::osyncstream).
+    ///
+    /// usage:
+    /// <pre>
+    ///   xtl::thread_buffered_ostream log([](std::string_view line) { fwrite(line.data(), 1, line.size(), stderr); });
+    ///   // on any thread
+    ///   log << "value = " << 42 << std::endl;
+    /// </pre>
+    template <class T = char>
+    class basic_thread_buffered_ostream final
+    {
+    public:
+        using char_type = T;
+        using string_view_type = std::basic_string_view<char_type>;
+        using callback_type = std::function<void(string_view_type)>;
+        using stream_type = basic_ostream_for_streambuf<char_type, basic_line_ostreambuf<char_type>>;
+
+    private:
+        // owned by the facade, and referred weakly by per-thread streams, which may outlive the facade until their threads exit.
+        struct core
+        {
+            callback_type sink;
+            bool serialize;
+            std::mutex mutex{};
+
+            core(callback_type sink, bool serialize) : sink(std::move(sink)), serialize(serialize) { }
+
+            void write_line(string_view_type line)
+            {
+                if (serialize)
+                {
+                    std::lock_guard lock(mutex);
+                    sink(line);
+                }
+                else
+                {
+                    sink(line);
+                }
+            }
+        };
+
+        struct thread_entry
+        {
+            std::weak_ptr<core> owner; // expired when the facade is destroyed
+            std::unique_ptr<stream_type> stream;
+        };
+
+        std::shared_ptr<core> core_;
+
+        // per-thread streams of all facades.
+        [[nodiscard]] static std::vector<thread_entry>& thread_streams()
+        {
+            static thread_local std::vector<thread_entry> streams;
+            return streams;
+        }
+
+    public:
+        /// @param sink receives each completed line (including the newline).
+        /// @param serialize_sink serializes sink calls by a mutex (set false if the sink is thread-safe).
+        explicit basic_thread_buffered_ostream(callback_type sink, bool serialize_sink = true)
+            : core_(std::make_shared<core>(std::move(sink), serialize_sink))
+        {
+        }
+
+        basic_thread_buffered_ostream(const basic_thread_buffered_ostream& other) = delete;
+        basic_thread_buffered_ostream(basic_thread_buffered_ostream&& other) noexcept = delete;
+        basic_thread_buffered_ostream& operator=(const basic_thread_buffered_ostream& other) = delete;
+        basic_thread_buffered_ostream& operator=(basic_thread_buffered_ostream&& other) noexcept = delete;
+        ~basic_thread_buffered_ostream() = default;
+
+        /// Gets the ostream for the current thread.
+        [[nodiscard]] std::basic_ostream<char_type>& stream()
+        {
+            auto& streams = thread_streams();
+
+            // compares by the control block, which is not reused while the entry refers it.
+            for (auto& e : streams)
+                if (!e.owner.owner_before(core_) && !core_.owner_before(e.owner))
+                    return *e.stream;
+
+            // drops streams of destroyed facades, their partial lines are discarded.
+            streams.erase(std::remove_if(streams.begin(), streams.end(), [](const thread_entry& e) { return e.owner.expired(); }), streams.end());
+
+            // the stream does not keep the core (and the user's sink) alive after the facade is destroyed.
+            auto s = std::make_unique<stream_type>([owner = std::weak_ptr<core>(core_)](string_view_type line)
+            {
+                if (auto c = owner.lock())
+                    c->write_line(line);
+            });
+            return *streams.emplace_back(thread_entry{core_, std::move(s)}).stream;
+        }
+
+        /// Gets the number of per-thread streams held by the current thread (including stale ones of destroyed facades not yet dropped).
+        /// Stale ones do not keep the sink of the destroyed facade alive, and discard their partial lines.
+        [[nodiscard]] static size_t thread_stream_count() noexcept
+        {
+            return thread_streams().size();
+        }
+
+        template <class U>
+        std::basic_ostream<char_type>& operator <<(U&& value)
+        {
+            return stream() << std::forward<U>(value);
+        }
+
+        std::basic_ostream<char_type>& operator <<(std::basic_ostream<char_type>& (*manipulator)(std::basic_ostream<char_type>&))
+        {
+            return stream() << manipulator;
+        }
+    };
+
+    using thread_buffered_ostream = basic_thread_buffered_ostream<char>;
 }
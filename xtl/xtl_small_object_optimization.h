@@ -13,17 +13,34 @@
 #include <variant>
 #include <typeindex>
 #include <any>
+#include <algorithm>
 #include <stdexcept>
+#include <utility>
+#include <cstring>
+#include <type_traits>
+#include <memory_resource>
+
+#include "xtl_type_key.h"
 
 namespace xtl
 {
+    /// Indicates T can be moved by memcpy and the source is left without destruction.
+    /// Specialize this as std::true_type for relocatable types which are not trivially copyable (e.g. holding std::unique_ptr).
+    template <class T>
+    struct is_trivially_relocatable : std::bool_constant<std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>>
+    {
+    };
+
+    template <class T>
+    static constexpr inline bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
     template <class alignment_t>
     struct small_object_optimization
     {
         static_assert(std::is_pod_v<alignment_t>);
 
         using soo_memory = alignment_t;
-        using heap_memory = alignment_t*;
+        using heap_memory = void*;
 
         union alignas(alignment_t) memory // = std::variant<empty_memory, soo_memory, heap_memory>;
         {
@@ -32,7 +49,7 @@ namespace xtl
         };
 
         template <class T>
-        static constexpr inline bool use_soo = (sizeof(T) <= sizeof(soo_memory)) && std::is_nothrow_move_constructible_v<T>;
+        static constexpr inline bool use_soo = (sizeof(T) <= sizeof(soo_memory)) && (alignof(T) <= alignof(soo_memory)) && std::is_nothrow_move_constructible_v<T>;
 
         template <class T>
         static T* pointer(memory& this_)
@@ -43,7 +60,7 @@ namespace xtl
             }
             else
             {
-                return reinterpret_cast<T*>(this_.heap_memory_);
+                return static_cast<T*>(this_.heap_memory_);
             }
         }
 
@@ -56,27 +73,58 @@ namespace xtl
             }
             else
             {
-                return reinterpret_cast<const T*>(this_.heap_memory_);
+                return static_cast<const T*>(this_.heap_memory_);
             }
         }
 
+        // heap block layout: [padding][memory_resource*][T], heap_memory_ points T.
+        template <class T> static constexpr inline size_t heap_offset = (sizeof(std::pmr::memory_resource*) + alignof(T) - 1) / alignof(T) * alignof(T);
+        template <class T> static constexpr inline size_t heap_size = heap_offset<T> + sizeof(T);
+        template <class T> static constexpr inline size_t heap_alignment = std::max(alignof(T), alignof(std::pmr::memory_resource*));
+
+        static std::pmr::memory_resource*& heap_resource(void* object) noexcept
+        {
+            return *reinterpret_cast<std::pmr::memory_resource**>(static_cast<std::byte*>(object) - sizeof(std::pmr::memory_resource*));
+        }
+
         using constructor_function = void(*)(memory&) noexcept;
 
+        /// Constructs T, allocating from `resource` if T does not fit in the soo memory.
         template <class T, class... A, std::enable_if_t<std::is_constructible_v<T, A&&...>>* = nullptr>
-        static T& construct(memory& this_, A&&... args)
+        static T& construct_on(memory& this_, std::pmr::memory_resource* resource, A&&... args)
         {
-            // alloc memory
             if constexpr (use_soo<T>)
             {
                 this_.soo_memory_ = soo_memory{};
+                return *new(pointer<T>(this_)) T(std::forward<A>(args)...);
             }
             else
             {
-                this_.heap_memory_ = new alignment_t[(sizeof(T) + sizeof(alignment_t) - 1) / sizeof(alignment_t)];
+                // alloc memory
+                std::byte* block = static_cast<std::byte*>(resource->allocate(heap_size<T>, heap_alignment<T>));
+                void* object = block + heap_offset<T>;
+                new(&heap_resource(object)) std::pmr::memory_resource*(resource);
+
+                // placement new
+                try
+                {
+                    T* p = new(object) T(std::forward<A>(args)...);
+                    this_.heap_memory_ = object;
+                    return *p;
+                }
+                catch (...)
+                {
+                    resource->deallocate(block, heap_size<T>, heap_alignment<T>);
+                    throw;
+                }
             }
+        }
 
-            // placement new
-            return *new(pointer<T>(this_)) T(std::forward<A>(args)...);
+        /// Constructs T, allocating from the default memory resource if T does not fit in the soo memory.
+        template <class T, class... A, std::enable_if_t<std::is_constructible_v<T, A&&...>>* = nullptr>
+        static T& construct(memory& this_, A&&... args)
+        {
+            return construct_on<T>(this_, std::pmr::get_default_resource(), std::forward<A>(args)...);
         }
 
         using move_constructor_function = void(*)(memory&, memory&&) noexcept;
@@ -96,6 +144,27 @@ namespace xtl
             }
         }
 
+        /// nullptr if T can be moved by memcpy. (heap object is always moved by its pointer.)
+        template <class T>
+        static constexpr inline move_constructor_function move_constructor_for = use_soo<T> && !is_trivially_relocatable_v<T> ? &move_construct<T> : nullptr;
+
+        /// Moves the object from `from` to `this_`.
+        static void relocate(memory& this_, memory&& from, move_constructor_function move_constructor) noexcept
+        {
+            if (move_constructor) { move_constructor(this_, std::move(from)); }
+            else { std::memcpy(&this_, &from, sizeof(memory)); }
+        }
+
+        using copy_constructor_function = void(*)(memory&, const memory&);
+
+        /// Copies the object, the heap object is allocated from the same resource as `from`.
+        template <class T>
+        static void copy_construct(memory& this_, const memory& from)
+        {
+            if constexpr (use_soo<T>) { construct_on<T>(this_, nullptr, *const_pointer<T>(from)); }
+            else { construct_on<T>(this_, heap_resource(from.heap_memory_), *const_pointer<T>(from)); }
+        }
+
         using destructor_function = void(*)(memory&) noexcept;
 
         template <class T>
@@ -111,23 +180,39 @@ namespace xtl
             }
             else
             {
-                delete[] this_.heap_memory_;
-                this_.heap_memory_ = nullptr;
+                void* object = std::exchange(this_.heap_memory_, nullptr);
+                heap_resource(object)->deallocate(static_cast<std::byte*>(object) - heap_offset<T>, heap_size<T>, heap_alignment<T>);
             }
         }
 
+        /// nullptr if destruction is no-op.
+        template <class T>
+        static constexpr inline destructor_function destructor_for = use_soo<T> && std::is_trivially_destructible_v<T> ? nullptr : &destruct<T>;
+
+        /// Destructs the object in `this_`.
+        static void destroy(memory& this_, destructor_function destructor) noexcept
+        {
+            if (destructor) { destructor(this_); }
+        }
+
         struct basic_vtable
         {
-            const std::type_info& type = typeid(void);
+            const type_key key;
+#if !defined(XTL_NO_RTTI)
+            const std::type_info& type;
+#endif
             const move_constructor_function move_constructor;
             const destructor_function destructor;
         };
 
         template <class T>
         static constexpr inline basic_vtable basic_vtable_for = {
+            type_key_of<T>,
+#if !defined(XTL_NO_RTTI)
             typeid(T),
-            &move_construct<T>,
-            &destruct<T>,
+#endif
+            move_constructor_for<T>,
+            destructor_for<T>,
         };
 
         template <class T>
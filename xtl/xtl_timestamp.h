@@ -8,9 +8,104 @@
 #include <chrono>
 #include <string>
 #include <ctime>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <cstring>
+#include <cstdint>
+
+#include "xtl_fixed_buffer_string.h"
 
 namespace xtl
 {
+    namespace timestamp_detail
+    {
+        /// the latest tick stored by coarse_timestamp_ticker, or 0 if no ticker is running.
+        inline std::atomic<int64_t> coarse_tick{};
+        inline std::atomic<int> coarse_ticker_count{};
+    }
+
+    /// timestamp string formats
+    enum struct timestamp_format
+    {
+        localtime,         ///< `2023-04-05 06:07:08.123456` in local time
+        utc,               ///< `2023-04-05 06:07:08.123456` in UTC
+        iso8601_localtime, ///< `2023-04-05T06:07:08.123456+09:00`
+        iso8601_utc,       ///< `2023-04-05T06:07:08.123456Z`
+    };
+
+    namespace timestamp_detail
+    {
+        template <size_t N>
+        inline char* write_digits(char* p, uint32_t value) noexcept
+        {
+            for (size_t i = N; i-- > 0; value /= 10)
+                p[i] = static_cast<char>('0' + value % 10);
+            return p + N;
+        }
+
+        /// Formatted date and time up to the second.
+        struct second_cache
+        {
+            int64_t second = INT64_MIN;
+            char prefix[19]; // `YYYY-MM-DD hh:mm:ss`
+            char suffix[6];  // time zone
+            size_t suffix_length;
+
+            void render(int64_t sec, timestamp_format format) noexcept
+            {
+                const bool local = format == timestamp_format::localtime || format == timestamp_format::iso8601_localtime;
+                const bool iso8601 = format == timestamp_format::iso8601_localtime || format == timestamp_format::iso8601_utc;
+
+                const auto time = static_cast<std::time_t>(sec);
+                std::tm tm{};
+#if defined(_MSC_VER)
+                if (local) localtime_s(&tm, &time);
+                else gmtime_s(&tm, &time);
+#else
+                if (local) localtime_r(&time, &tm);
+                else gmtime_r(&time, &tm);
+#endif
+
+                char* p = prefix;
+                p = write_digits<4>(p, static_cast<uint32_t>(tm.tm_year + 1900));
+                *p++ = '-';
+                p = write_digits<2>(p, static_cast<uint32_t>(tm.tm_mon + 1));
+                *p++ = '-';
+                p = write_digits<2>(p, static_cast<uint32_t>(tm.tm_mday));
+                *p++ = iso8601 ? 'T' : ' ';
+                p = write_digits<2>(p, static_cast<uint32_t>(tm.tm_hour));
+                *p++ = ':';
+                p = write_digits<2>(p, static_cast<uint32_t>(tm.tm_min));
+                *p++ = ':';
+                write_digits<2>(p, static_cast<uint32_t>(tm.tm_sec));
+
+                suffix_length = 0;
+                if (format == timestamp_format::iso8601_utc)
+                {
+                    suffix[suffix_length++] = 'Z';
+                }
+                else if (format == timestamp_format::iso8601_localtime)
+                {
+#if defined(_MSC_VER)
+                    const auto offset = static_cast<long>(_mkgmtime(&tm) - time);
+#else
+                    const auto offset = static_cast<long>(tm.tm_gmtoff);
+#endif
+                    const auto minutes = static_cast<uint32_t>((offset < 0 ? -offset : offset) / 60);
+                    suffix[0] = offset < 0 ? '-' : '+';
+                    write_digits<2>(suffix + 1, minutes / 60);
+                    suffix[3] = ':';
+                    write_digits<2>(suffix + 4, minutes % 60);
+                    suffix_length = 6;
+                }
+
+                second = sec;
+            }
+        };
+    }
+
     struct timestamp
     {
         using unit = std::chrono::microseconds;
@@ -35,6 +130,16 @@ namespace xtl
             return timestamp{duration_cast<unit>(high_resolution_clock::now().time_since_epoch()).count() + epochOffset};
         }
 
+        /// Gets the current time cached by a running `coarse_timestamp_ticker`, as accurate as its period.
+        /// It is a single atomic load. Falls back to now() if no ticker is running.
+        [[nodiscard]] static inline timestamp coarse_now() noexcept
+        {
+            if (auto tick = timestamp_detail::coarse_tick.load(std::memory_order_relaxed))
+                return timestamp{tick};
+
+            return now();
+        }
+
         [[nodiscard]] long double to_seconds() const noexcept
         {
             return static_cast<double>(static_cast<long double>(tick) / static_cast<long double>(ticks_per_second));
@@ -46,24 +151,49 @@ namespace xtl
             return system_clock::from_time_t(0) + duration_cast<system_clock::duration>(unit(tick));
         }
 
-        [[nodiscard]] std::string to_localtime_string() const noexcept
+        /// Max length of formatted string.
+        static constexpr inline size_t max_formatted_length = 32;
+
+        /// Writes formatted string (not null-terminated, at most max_formatted_length chars) to `out`.
+        /// The date and time up to the second are cached per thread, so that it costs only rendering microseconds in most cases.
+        /// returns the end of written string.
+        char* format_to(char* out, timestamp_format format = timestamp_format::localtime) const noexcept
         {
-            auto time = std::chrono::system_clock::to_time_t(to_system_clock_time_point());
-            std::tm tm{};
-#if defined(_MSC_VER)
-            localtime_s(&tm, &time);
-#else
-            localtime_r(&time, &tm); // since C23
-            //localtime_s(&time, &tm); // since C11
-            //tm = *localtime(&time);
-#endif
+            static_assert(unit::period::num == 1 && unit::period::den == 1000000);
+            const value_type second = (tick >= 0 ? tick : tick - (ticks_per_second - 1)) / ticks_per_second; // floor
+            const auto microsecond = static_cast<uint32_t>(tick - second * ticks_per_second);
 
-            char str[64]{};
-            size_t len = std::strftime(str, sizeof(str), "%Y-%m-%d %H:%M:%S", &tm);
+            static thread_local timestamp_detail::second_cache caches[4]{};
+            auto& cache = caches[static_cast<size_t>(format) & 3];
+            if (cache.second != second)
+                cache.render(second, format);
 
-            static_assert(unit::period::num == 1 && unit::period::den == 1000000);
-            std::snprintf(str + len, sizeof(str) - len, ".%06d", static_cast<int>(tick * unit::period::num % unit::period::den));
-            return std::string(str);
+            std::memcpy(out, cache.prefix, sizeof(cache.prefix));
+            out += sizeof(cache.prefix);
+            *out++ = '.';
+            out = timestamp_detail::write_digits<6>(out, microsecond);
+            std::memcpy(out, cache.suffix, cache.suffix_length);
+            return out + cache.suffix_length;
+        }
+
+        /// Gets formatted string without allocation.
+        [[nodiscard]] fixed_buffer_string<max_formatted_length> to_fixed_string(timestamp_format format = timestamp_format::localtime) const noexcept
+        {
+            fixed_buffer_string<max_formatted_length> str;
+            str.resize(static_cast<size_t>(format_to(str.data(), format) - str.data()));
+            return str;
+        }
+
+        [[nodiscard]] std::string to_localtime_string() const noexcept
+        {
+            char str[max_formatted_length];
+            return std::string(str, format_to(str, timestamp_format::localtime));
+        }
+
+        [[nodiscard]] std::string to_utc_string(timestamp_format format = timestamp_format::iso8601_utc) const noexcept
+        {
+            char str[max_formatted_length];
+            return std::string(str, format_to(str, format));
         }
 
         bool operator ==(timestamp rhs) const { return tick == rhs.tick; }
@@ -74,6 +204,54 @@ namespace xtl
         bool operator >=(timestamp rhs) const { return tick >= rhs.tick; }
     };
 
+    /// Updates the time for timestamp::coarse_now() on a background thread at the period while it lives.
+    ///
+    /// usage:
+    /// <pre>
+    ///   xtl::coarse_timestamp_ticker ticker(std::chrono::milliseconds(1)); // at startup
+    ///   ...
+    ///   auto t = xtl::timestamp::coarse_now(); // on hot paths
+    /// </pre>
+    class coarse_timestamp_ticker final
+    {
+        std::mutex mutex_{};
+        std::condition_variable cv_{};
+        bool stop_{};
+        std::thread thread_{};
+
+    public:
+        explicit coarse_timestamp_ticker(std::chrono::microseconds period = std::chrono::milliseconds(1))
+        {
+            timestamp_detail::coarse_tick.store(timestamp::now().tick, std::memory_order_relaxed);
+            timestamp_detail::coarse_ticker_count.fetch_add(1, std::memory_order_relaxed);
+
+            thread_ = std::thread([this, period]
+            {
+                std::unique_lock lock(mutex_);
+                while (!cv_.wait_for(lock, period, [this] { return stop_; }))
+                    timestamp_detail::coarse_tick.store(timestamp::now().tick, std::memory_order_relaxed);
+            });
+        }
+
+        coarse_timestamp_ticker(const coarse_timestamp_ticker& other) = delete;
+        coarse_timestamp_ticker(coarse_timestamp_ticker&& other) noexcept = delete;
+        coarse_timestamp_ticker& operator=(const coarse_timestamp_ticker& other) = delete;
+        coarse_timestamp_ticker& operator=(coarse_timestamp_ticker&& other) noexcept = delete;
+
+        ~coarse_timestamp_ticker()
+        {
+            {
+                std::lock_guard lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            thread_.join();
+
+            if (timestamp_detail::coarse_ticker_count.fetch_sub(1, std::memory_order_relaxed) == 1)
+                timestamp_detail::coarse_tick.store(0, std::memory_order_relaxed); // falls back to now()
+        }
+    };
+
     static_assert(std::is_standard_layout_v<timestamp>);
     static_assert(std::is_trivial_v<timestamp>);
     static_assert(sizeof(timestamp) == sizeof(int64_t));
@@ -5,19 +5,21 @@
 
 #pragma once
 
-#include <typeindex>
+#include <algorithm>
 #include <unordered_map>
 #include <stdexcept>
+#include <vector>
 
 #include "xtl_any.h"
+#include "xtl_type_key.h"
 
 namespace xtl
 {
     class type_indexed_map final
     {
-        // type_index(T) -> T
-        std::unordered_map<std::type_index, any> container_{};
-        template <class T> static inline std::type_index index = std::type_index(typeid(T));
+        // type_key(T) -> T (hashed by the pointer, node based to keep references stable)
+        std::unordered_map<type_key, any> container_{};
+        template <class T> static constexpr inline type_key index = type_key_of<T>;
 
     public:
         type_indexed_map() = default;
@@ -80,9 +82,93 @@ namespace xtl
         }
 
         template <class T>
-        void erase()
+        size_t erase()
         {
             return container_.erase(index<T>);
         }
     };
+
+    /// type_indexed_map backed by a flat array of `any` slots indexed by a process-wide sequential type index.
+    /// find<T>() is a bounds check plus an array load.
+    /// Inserting a type which is newer than all stored ones may grow the array and invalidate references to the values.
+    class dense_type_indexed_map final
+    {
+        // dense_type_index(T) -> T
+        std::vector<any> slots_{};
+        template <class T> static size_t index() noexcept { return dense_type_index<T>(); }
+
+        any& slot(size_t i)
+        {
+            if (i >= slots_.size())
+                slots_.resize(std::max(i + 1, dense_type_index_count()));
+            return slots_[i];
+        }
+
+    public:
+        dense_type_indexed_map() = default;
+        dense_type_indexed_map(const dense_type_indexed_map& other) = delete;
+        dense_type_indexed_map(dense_type_indexed_map&& other) noexcept = default;
+        dense_type_indexed_map& operator=(const dense_type_indexed_map& other) = delete;
+        dense_type_indexed_map& operator=(dense_type_indexed_map&& other) noexcept = default;
+        ~dense_type_indexed_map() = default;
+
+        template <class T>
+        T& insert(std::decay_t<T> value)
+        {
+            return slot(index<T>()).template emplace<T>(std::move(value));
+        }
+
+        template <class T, class...Args>
+        T& emplace(Args&&...args)
+        {
+            return slot(index<T>()).template emplace<T>(std::forward<Args>(args)...);
+        }
+
+        template <class T>
+        [[nodiscard]] const T* find() const noexcept
+        {
+            if (size_t i = index<T>(); i < slots_.size())
+                return slots_[i].template get_if<T>();
+
+            return nullptr; // not set
+        }
+
+        template <class T>
+        [[nodiscard]] T* find() noexcept
+        {
+            return const_cast<T*>(const_cast<const dense_type_indexed_map*>(this)->find<T>());
+        }
+
+        template <class T>
+        [[nodiscard]] size_t count() const noexcept
+        {
+            return find<T>() ? 1 : 0;
+        }
+
+        template <class T>
+        [[nodiscard]] const T& at() const
+        {
+            if (auto* p = find<T>())
+                return *p;
+
+            throw std::out_of_range("no such key");
+        }
+
+        template <class T>
+        [[nodiscard]] T& at()
+        {
+            return const_cast<T&>(const_cast<const dense_type_indexed_map*>(this)->at<T>());
+        }
+
+        template <class T>
+        size_t erase()
+        {
+            if (size_t i = index<T>(); i < slots_.size() && slots_[i].has_value())
+            {
+                slots_[i].reset();
+                return 1;
+            }
+            return 0;
+        }
+    };
 }
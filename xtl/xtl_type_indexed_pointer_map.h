@@ -5,18 +5,37 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <memory>
-#include <typeindex>
-#include <unordered_map>
+#include <mutex>
 #include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "xtl_type_key.h"
 
 namespace xtl
 {
     class type_indexed_pointer_map
     {
-        // type_index(T) -> T
-        std::unordered_map<std::type_index, std::shared_ptr<void>> container_{};
-        template <class T> static inline std::type_index index = std::type_index(typeid(T*));
+        // type_key(T) -> T (sorted by key, looked up by binary search with pointer comparison)
+        using value_type = std::pair<type_key, std::shared_ptr<void>>;
+        std::vector<value_type> container_{};
+        template <class T> static constexpr inline type_key index = type_key_of<T>;
+
+        [[nodiscard]] auto lower_bound(type_key key) const noexcept
+        {
+            return std::lower_bound(
+                container_.begin(), container_.end(), key,
+                [](const value_type& e, type_key k) { return e.first < k; });
+        }
+
+        [[nodiscard]] auto lower_bound(type_key key) noexcept
+        {
+            return container_.begin() + (std::as_const(*this).lower_bound(key) - container_.cbegin());
+        }
 
     public:
         type_indexed_pointer_map() = default;
@@ -30,7 +49,10 @@ namespace xtl
         T* insert(std::shared_ptr<T> p)
         {
             auto r = p.get();
-            container_.insert_or_assign(index<T>, std::move(p));
+            if (auto it = lower_bound(index<T>); it != container_.end() && it->first == index<T>)
+                it->second = std::move(p);
+            else
+                container_.emplace(it, index<T>, std::move(p));
             return r;
         }
 
@@ -43,12 +65,145 @@ namespace xtl
         template <class T>
         [[nodiscard]] T* find() const noexcept
         {
-            if (auto it = container_.find(index<T>); it != container_.end())
-                return std::static_pointer_cast<T>(it->second);
+            if (auto it = lower_bound(index<T>); it != container_.end() && it->first == index<T>)
+                return static_cast<T*>(it->second.get());
+
+            return nullptr; // not set
+        }
+
+        template <class T>
+        [[nodiscard]] size_t count() const noexcept
+        {
+            return find<T>() ? 1 : 0;
+        }
+
+        template <class T>
+        [[nodiscard]] T* at() const
+        {
+            if (auto* p = find<T>())
+                return p;
+
+            throw std::out_of_range("no such key");
+        }
+
+        template <class T>
+        size_t erase()
+        {
+            if (auto it = lower_bound(index<T>); it != container_.end() && it->first == index<T>)
+            {
+                container_.erase(it);
+                return 1;
+            }
+            return 0;
+        }
+    };
+
+    /// Thread-safe type_indexed_pointer_map for read-mostly use, e.g. a service registry.
+    /// find<T>() is lock-free: each type has an atomic slot at its dense_type_index,
+    /// and the resolved pointer is cached per thread until the next modification of the map.
+    /// insert/emplace/erase take a writer lock.
+    /// Replaced or erased objects are kept alive until the map is destroyed,
+    /// so the pointers returned by find<T>() stay valid as long as the map lives.
+    class concurrent_type_indexed_pointer_map final
+    {
+        struct table
+        {
+            size_t size{};
+            std::unique_ptr<std::atomic<void*>[]> slots{};
+        };
+
+        mutable std::mutex mutex_{}; // serializes writers
+        std::vector<std::shared_ptr<void>> owners_{};  // dense_type_index(T) -> T (guarded by mutex_)
+        std::vector<std::shared_ptr<void>> retired_{}; // replaced or erased objects (guarded by mutex_)
+        std::vector<std::unique_ptr<table>> tables_{}; // all tables ever published, the last one is current (guarded by mutex_)
+        std::atomic<const table*> table_{};            // current table
+        std::atomic<uint64_t> version_{};              // incremented on each modification
+
+        // identifies the map in thread-local caches (never reused, unlike the address of the map)
+        const uint64_t instance_id_ = []
+        {
+            static std::atomic<uint64_t> next_instance_id{1};
+            return next_instance_id.fetch_add(1, std::memory_order_relaxed);
+        }();
+
+        template <class T> static size_t index() noexcept { return dense_type_index<T>(); }
+
+        // requires mutex_
+        std::atomic<void*>& slot(size_t i)
+        {
+            const table* current = table_.load(std::memory_order_relaxed);
+            if (!current || i >= current->size)
+            {
+                auto t = std::make_unique<table>();
+                t->size = std::max(i + 1, dense_type_index_count());
+                t->slots = std::make_unique<std::atomic<void*>[]>(t->size);
+                for (size_t j = 0; current && j < current->size; j++)
+                    t->slots[j].store(current->slots[j].load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+                owners_.resize(t->size);
+                tables_.push_back(std::move(t));
+                current = tables_.back().get();
+                table_.store(current, std::memory_order_release);
+            }
+            return current->slots[i];
+        }
+
+        template <class T>
+        [[nodiscard]] T* find_uncached() const noexcept
+        {
+            if (const table* t = table_.load(std::memory_order_acquire); t && index<T>() < t->size)
+                return static_cast<T*>(t->slots[index<T>()].load(std::memory_order_acquire));
 
             return nullptr; // not set
         }
 
+    public:
+        concurrent_type_indexed_pointer_map() = default;
+        concurrent_type_indexed_pointer_map(const concurrent_type_indexed_pointer_map& other) = delete;
+        concurrent_type_indexed_pointer_map(concurrent_type_indexed_pointer_map&& other) noexcept = delete;
+        concurrent_type_indexed_pointer_map& operator=(const concurrent_type_indexed_pointer_map& other) = delete;
+        concurrent_type_indexed_pointer_map& operator=(concurrent_type_indexed_pointer_map&& other) noexcept = delete;
+        ~concurrent_type_indexed_pointer_map() = default;
+
+        template <class T>
+        T* insert(std::shared_ptr<T> p)
+        {
+            std::lock_guard lock(mutex_);
+            auto r = p.get();
+            auto& s = slot(index<T>());
+            if (auto& owner = owners_[index<T>()]) retired_.push_back(std::move(owner));
+            owners_[index<T>()] = std::move(p);
+            s.store(r, std::memory_order_release);
+            version_.fetch_add(1, std::memory_order_release);
+            return r;
+        }
+
+        template <class T, class U = T, class... Args>
+        T* emplace(Args&&... args)
+        {
+            return this->insert<T>(std::make_shared<U>(std::forward<Args>(args)...));
+        }
+
+        template <class T>
+        [[nodiscard]] T* find() const noexcept
+        {
+            struct cache
+            {
+                uint64_t instance_id;
+                uint64_t version;
+                T* pointer;
+            };
+            static thread_local cache cached{};
+
+            const uint64_t version = version_.load(std::memory_order_acquire);
+            if (cached.instance_id == instance_id_ && cached.version == version)
+                return cached.pointer;
+
+            T* p = find_uncached<T>();
+            cached = cache{instance_id_, version, p};
+            return p;
+        }
+
         template <class T>
         [[nodiscard]] size_t count() const noexcept
         {
@@ -56,7 +211,7 @@ namespace xtl
         }
 
         template <class T>
-        [[nodiscard]] T* at() const noexcept
+        [[nodiscard]] T* at() const
         {
             if (auto* p = find<T>())
                 return p;
@@ -67,7 +222,16 @@ namespace xtl
         template <class T>
         size_t erase()
         {
-            return container_.erase(index<T>);
+            std::lock_guard lock(mutex_);
+            if (index<T>() < owners_.size() && owners_[index<T>()])
+            {
+                table_.load(std::memory_order_relaxed)->slots[index<T>()].store(nullptr, std::memory_order_release);
+                retired_.push_back(std::move(owners_[index<T>()]));
+                owners_[index<T>()].reset();
+                version_.fetch_add(1, std::memory_order_release);
+                return 1;
+            }
+            return 0;
         }
     };
 }
@@ -0,0 +1,97 @@
+/// @file
+/// @brief  xtl::type_key - RTTI-free compile-time type identifier
+/// @author (C) 2023 ttsuki
+/// Distributed under the Boost Software License, Version 1.0.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#if !defined(XTL_NO_RTTI) && !(defined(__cpp_rtti) || defined(__GXX_RTTI) || defined(_CPPRTTI))
+#define XTL_NO_RTTI
+#endif
+
+namespace xtl
+{
+    namespace type_key_detail
+    {
+        template <class T>
+        struct tag
+        {
+            // mutable (never written) so that identical code folding never merges the objects of different types.
+            static inline char id{};
+        };
+
+        inline std::atomic<size_t> next_dense_index{0};
+
+        template <class T>
+        [[nodiscard]] inline size_t assign_dense_index() noexcept
+        {
+            static const size_t index = next_dense_index.fetch_add(1, std::memory_order_relaxed);
+            return index;
+        }
+
+        // index + 1, cached by the static initialization so that lookups skip the guard of the function-local static.
+        // 0 (zero-initialized) if read before the dynamic initialization.
+        template <class T>
+        inline const size_t cached_dense_index = assign_dense_index<T>() + 1;
+    }
+
+    /// Identifies a type by the address of a per-type static object.
+    /// Comparison is a pointer comparison, and no RTTI is required.
+    class type_key final
+    {
+        const void* key_{};
+
+        constexpr explicit type_key(const void* key) noexcept : key_(key) { }
+
+    public:
+        constexpr type_key() noexcept = default;
+
+        template <class T>
+        [[nodiscard]] static constexpr type_key of() noexcept { return type_key(&type_key_detail::tag<T>::id); }
+
+        [[nodiscard]] constexpr const void* value() const noexcept { return key_; }
+        [[nodiscard]] constexpr explicit operator bool() const noexcept { return key_ != nullptr; }
+
+        [[nodiscard]] friend constexpr bool operator ==(type_key lhs, type_key rhs) noexcept { return lhs.key_ == rhs.key_; }
+        [[nodiscard]] friend constexpr bool operator !=(type_key lhs, type_key rhs) noexcept { return lhs.key_ != rhs.key_; }
+        [[nodiscard]] friend bool operator <(type_key lhs, type_key rhs) noexcept { return std::less<const void*>()(lhs.key_, rhs.key_); }
+        [[nodiscard]] friend bool operator >(type_key lhs, type_key rhs) noexcept { return rhs < lhs; }
+        [[nodiscard]] friend bool operator <=(type_key lhs, type_key rhs) noexcept { return !(rhs < lhs); }
+        [[nodiscard]] friend bool operator >=(type_key lhs, type_key rhs) noexcept { return !(lhs < rhs); }
+    };
+
+    /// type_key of T
+    template <class T>
+    static constexpr inline type_key type_key_of = type_key::of<T>();
+
+    /// Process-wide sequential index of T, assigned on first use.
+    /// Indices are small and dense, so they can be used to index a flat array.
+    template <class T>
+    [[nodiscard]] inline size_t dense_type_index() noexcept
+    {
+        if (const size_t cached = type_key_detail::cached_dense_index<T>)
+            return cached - 1;
+
+        return type_key_detail::assign_dense_index<T>(); // during the static initialization
+    }
+
+    /// Number of dense type indices assigned so far.
+    [[nodiscard]] inline size_t dense_type_index_count() noexcept
+    {
+        return type_key_detail::next_dense_index.load(std::memory_order_relaxed);
+    }
+}
+
+namespace std
+{
+    template <>
+    struct hash<xtl::type_key>
+    {
+        size_t operator()(xtl::type_key key) const noexcept { return std::hash<const void*>()(key.value()); }
+    };
+}
\ No newline at end of file
@@ -5,17 +5,171 @@
 
 #pragma once
 
+#include <new>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
 #include <variant>
+#include <type_traits>
 
 namespace xtl
 {
+    template <class TValue, class TError>
+    class value_or_error;
+
+    namespace value_or_error_detail
+    {
+        template <class TValue, class TError>
+        static constexpr inline bool is_trivial =
+            std::is_trivially_copyable_v<TValue> && std::is_trivially_destructible_v<TValue> &&
+            std::is_trivially_copyable_v<TError> && std::is_trivially_destructible_v<TError>;
+
+        /// Storage: a union of TValue and TError with a flag.
+        /// Trivially copyable if both types are.
+        template <class TValue, class TError, bool = is_trivial<TValue, TError>>
+        struct storage
+        {
+            union
+            {
+                TValue value_;
+                TError error_;
+            };
+
+            bool has_value_;
+
+            template <class... Args>
+            constexpr storage(std::in_place_index_t<0>, Args&&... args) : value_(std::forward<Args>(args)...), has_value_(true) { }
+
+            template <class... Args>
+            constexpr storage(std::in_place_index_t<1>, Args&&... args) : error_(std::forward<Args>(args)...), has_value_(false) { }
+        };
+
+        template <class TValue, class TError>
+        struct storage<TValue, TError, false>
+        {
+            union
+            {
+                TValue value_;
+                TError error_;
+            };
+
+            bool has_value_;
+
+            template <class... Args>
+            storage(std::in_place_index_t<0>, Args&&... args) : value_(std::forward<Args>(args)...), has_value_(true) { }
+
+            template <class... Args>
+            storage(std::in_place_index_t<1>, Args&&... args) : error_(std::forward<Args>(args)...), has_value_(false) { }
+
+            storage(const storage& other) : has_value_(other.has_value_)
+            {
+                if (has_value_) new(std::addressof(value_)) TValue(other.value_);
+                else new(std::addressof(error_)) TError(other.error_);
+            }
+
+            storage(storage&& other) noexcept(std::is_nothrow_move_constructible_v<TValue> && std::is_nothrow_move_constructible_v<TError>)
+                : has_value_(other.has_value_)
+            {
+                if (has_value_) new(std::addressof(value_)) TValue(std::move(other.value_));
+                else new(std::addressof(error_)) TError(std::move(other.error_));
+            }
+
+            storage& operator=(const storage& other)
+            {
+                if (this != std::addressof(other))
+                {
+                    if (has_value_ && other.has_value_) value_ = other.value_;
+                    else if (!has_value_ && !other.has_value_) error_ = other.error_;
+                    else *this = storage(other);
+                }
+                return *this;
+            }
+
+            storage& operator=(storage&& other) noexcept(std::is_nothrow_move_constructible_v<TValue> && std::is_nothrow_move_constructible_v<TError> &&
+                std::is_nothrow_move_assignable_v<TValue> && std::is_nothrow_move_assignable_v<TError>)
+            {
+                static_assert(std::is_nothrow_move_constructible_v<TValue> && std::is_nothrow_move_constructible_v<TError>,
+                              "value_or_error is assignable only if both types are nothrow move constructible.");
+
+                if (this != std::addressof(other))
+                {
+                    if (has_value_ && other.has_value_) value_ = std::move(other.value_);
+                    else if (!has_value_ && !other.has_value_) error_ = std::move(other.error_);
+                    else
+                    {
+                        this->~storage();
+                        new(this) storage(std::move(other));
+                    }
+                }
+                return *this;
+            }
+
+            ~storage()
+            {
+                if (has_value_) value_.~TValue();
+                else error_.~TError();
+            }
+        };
+
+        /// Empty base which deletes copy construction/assignment unless both types support them,
+        /// because the storage declares them unconditionally.
+        template <bool CopyConstructible, bool CopyAssignable>
+        struct copy_control
+        {
+        };
+
+        template <>
+        struct copy_control<true, false>
+        {
+            copy_control() = default;
+            copy_control(const copy_control& other) = default;
+            copy_control(copy_control&& other) noexcept = default;
+            copy_control& operator=(const copy_control& other) = delete;
+            copy_control& operator=(copy_control&& other) noexcept = default;
+            ~copy_control() = default;
+        };
+
+        template <>
+        struct copy_control<false, false>
+        {
+            copy_control() = default;
+            copy_control(const copy_control& other) = delete;
+            copy_control(copy_control&& other) noexcept = default;
+            copy_control& operator=(const copy_control& other) = delete;
+            copy_control& operator=(copy_control&& other) noexcept = default;
+            ~copy_control() = default;
+        };
+
+        template <class TValue, class TError>
+        using copy_control_for = copy_control<
+            std::is_copy_constructible_v<TValue> && std::is_copy_constructible_v<TError>,
+            std::is_copy_constructible_v<TValue> && std::is_copy_constructible_v<TError> &&
+            std::is_copy_assignable_v<TValue> && std::is_copy_assignable_v<TError>>;
+
+        template <class T>
+        struct is_value_or_error : std::false_type
+        {
+        };
+
+        template <class TValue, class TError>
+        struct is_value_or_error<value_or_error<TValue, TError>> : std::true_type
+        {
+        };
+    }
+
     /// Represents a value or a error.
+    /// It holds either of them (never empty, use `std::optional` as TValue for optional values),
+    /// and is trivially copyable if both TValue and TError are.
     template <class TValue, class TError>
-    class value_or_error
+    class value_or_error : value_or_error_detail::copy_control_for<TValue, TError>
     {
-        std::variant<std::nullptr_t, TValue, TError> var_;
+        value_or_error_detail::storage<TValue, TError> storage_;
 
     public:
+        using value_type = TValue;
+        using error_type = TError;
+
         /// tags for dispatch
         template <size_t TIndex>
         struct tag : std::integral_constant<size_t, TIndex>
@@ -26,33 +180,107 @@ namespace xtl
         using holds_error = tag<2>;
 
     public:
-        value_or_error() = default;
+        /// Constructs holding a value-initialized TValue.
+        template <class V = TValue, std::enable_if_t<std::is_default_constructible_v<V>>* = nullptr>
+        value_or_error() : storage_(std::in_place_index<0>) { }
+
+        value_or_error(const TValue& value, holds_value = {}) : storage_(std::in_place_index<0>, value) { }
+        value_or_error(TValue&& value, holds_value = {}) : storage_(std::in_place_index<0>, std::move(value)) { }
+
+        value_or_error(const TError& error, holds_error = {}) : storage_(std::in_place_index<1>, error) { }
+        value_or_error(TError&& error, holds_error = {}) : storage_(std::in_place_index<1>, std::move(error)) { }
+
+        template <class... Args>
+        value_or_error(holds_value, std::in_place_t, Args&&... args) : storage_(std::in_place_index<0>, std::forward<Args>(args)...) { }
+
+        template <class... Args>
+        value_or_error(holds_error, std::in_place_t, Args&&... args) : storage_(std::in_place_index<1>, std::forward<Args>(args)...) { }
+
+        [[nodiscard]] bool has_value() const noexcept { return storage_.has_value_; }
+        [[nodiscard]] TValue& value() & { return check(has_value()), storage_.value_; }
+        [[nodiscard]] const TValue& value() const & { return check(has_value()), storage_.value_; }
+        [[nodiscard]] TValue&& value() && { return check(has_value()), std::move(storage_.value_); }
+
+        [[nodiscard]] bool has_error() const noexcept { return !storage_.has_value_; }
+        [[nodiscard]] TError& error() & { return check(has_error()), storage_.error_; }
+        [[nodiscard]] const TError& error() const & { return check(has_error()), storage_.error_; }
+        [[nodiscard]] TError&& error() && { return check(has_error()), std::move(storage_.error_); }
+
+        [[nodiscard]] explicit operator bool() const noexcept { return has_value(); }
+
+        template <class U = TValue>
+        [[nodiscard]] TValue value_or(U&& value_if_error = {}) const & { return has_value() ? storage_.value_ : static_cast<TValue>(std::forward<U>(value_if_error)); }
+
+        template <class U = TValue>
+        [[nodiscard]] TValue value_or(U&& value_if_error = {}) && { return has_value() ? std::move(storage_.value_) : static_cast<TValue>(std::forward<U>(value_if_error)); }
 
-        value_or_error(TValue value, holds_value = {})
-            : var_(std::forward<TValue>(value))
+        TValue& operator *() & { return value(); }
+        const TValue& operator *() const & { return value(); }
+        TValue&& operator *() && { return std::move(*this).value(); }
+
+        TValue* operator ->() { return &value(); }
+        const TValue* operator ->() const { return &value(); }
+
+        /// Calls f(value) which returns value_or_error<U, TError>, or propagates the error.
+        template <class F> auto and_then(F&& f) & { return and_then_impl(*this, std::forward<F>(f)); }
+        template <class F> auto and_then(F&& f) const & { return and_then_impl(*this, std::forward<F>(f)); }
+        template <class F> auto and_then(F&& f) && { return and_then_impl(std::move(*this), std::forward<F>(f)); }
+
+        /// Maps the value by f(value), or propagates the error.
+        template <class F> auto transform(F&& f) & { return transform_impl(*this, std::forward<F>(f)); }
+        template <class F> auto transform(F&& f) const & { return transform_impl(*this, std::forward<F>(f)); }
+        template <class F> auto transform(F&& f) && { return transform_impl(std::move(*this), std::forward<F>(f)); }
+
+        /// Calls f(error) which returns value_or_error<TValue, U>, or propagates the value.
+        template <class F> auto or_else(F&& f) & { return or_else_impl(*this, std::forward<F>(f)); }
+        template <class F> auto or_else(F&& f) const & { return or_else_impl(*this, std::forward<F>(f)); }
+        template <class F> auto or_else(F&& f) && { return or_else_impl(std::move(*this), std::forward<F>(f)); }
+
+    private:
+        static void check(bool holds)
         {
+            if (!holds) throw std::bad_variant_access();
         }
 
-        value_or_error(TError error, holds_error = {})
-            : var_(std::forward<TError>(error))
+        template <class Self, class F>
+        static auto and_then_impl(Self&& self, F&& f)
         {
-        }
+            using result = std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F, decltype((std::forward<Self>(self).storage_.value_))>>>;
+            static_assert(value_or_error_detail::is_value_or_error<result>::value, "f must return value_or_error.");
 
-        [[nodiscard]] bool has_value() const noexcept { return var_.index() == holds_value::value; }
-        [[nodiscard]] TValue& value() { return std::get<holds_value::value>(var_); }
-        [[nodiscard]] const TValue& value() const { return std::get<holds_value::value>(var_); }
+            if (self.has_value()) return std::invoke(std::forward<F>(f), std::forward<Self>(self).storage_.value_);
+            return result(typename result::holds_error{}, std::in_place, std::forward<Self>(self).storage_.error_);
+        }
 
-        [[nodiscard]] bool has_error() const noexcept { return var_.index() == holds_error::value; }
-        [[nodiscard]] TError& error() { return std::get<holds_error::value>(var_); }
-        [[nodiscard]] const TError& error() const { return std::get<holds_error::value>(var_); }
+        template <class Self, class F>
+        static auto transform_impl(Self&& self, F&& f)
+        {
+            using result = value_or_error<std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F, decltype((std::forward<Self>(self).storage_.value_))>>>, TError>;
 
-        [[nodiscard]] explicit operator bool() const { return has_value(); }
-        [[nodiscard]] TValue value_or(TValue value_if_error = {}) const { return has_value() ? value() : value_if_error; }
+            if (self.has_value()) return result(typename result::holds_value{}, std::in_place, std::invoke(std::forward<F>(f), std::forward<Self>(self).storage_.value_));
+            return result(typename result::holds_error{}, std::in_place, std::forward<Self>(self).storage_.error_);
+        }
 
-        TValue& operator *() { return value(); }
-        const TValue& operator *() const { return value(); }
+        template <class Self, class F>
+        static auto or_else_impl(Self&& self, F&& f)
+        {
+            using result = std::remove_cv_t<std::remove_reference_t<std::invoke_result_t<F, decltype((std::forward<Self>(self).storage_.error_))>>>;
+            static_assert(value_or_error_detail::is_value_or_error<result>::value, "f must return value_or_error.");
 
-        TValue* operator ->() { return &value(); }
-        const TValue* operator ->() const { return &value(); }
+            if (self.has_error()) return std::invoke(std::forward<F>(f), std::forward<Self>(self).storage_.error_);
+            return result(typename result::holds_value{}, std::in_place, std::forward<Self>(self).storage_.value_);
+        }
     };
+    // trait test
+    namespace value_or_error_detail::trait_test
+    {
+        static_assert(std::is_trivially_copyable_v<value_or_error<int*, int>>);
+        static_assert(std::is_copy_constructible_v<value_or_error<std::string, int>>);
+        static_assert(std::is_copy_assignable_v<value_or_error<std::string, int>>);
+        static_assert(!std::is_copy_constructible_v<value_or_error<std::unique_ptr<int>, int>>);
+        static_assert(!std::is_copy_assignable_v<value_or_error<std::unique_ptr<int>, int>>);
+        static_assert(!std::is_copy_constructible_v<value_or_error<int, std::unique_ptr<int>>>);
+        static_assert(std::is_nothrow_move_constructible_v<value_or_error<std::unique_ptr<int>, int>>);
+        static_assert(std::is_nothrow_move_assignable_v<value_or_error<std::unique_ptr<int>, int>>);
+    }
 }
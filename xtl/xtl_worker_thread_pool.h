@@ -10,6 +10,7 @@
 #include <thread>
 #include <functional>
 #include <future>
+#include <memory_resource>
 
 #include "xtl_delegate.h"
 #include "xtl_concurrent_queue.h"
@@ -17,9 +18,10 @@
 namespace xtl
 {
     /// makes move-only packaged_task-like object.
+    /// the task body is allocated from `resource` if it does not fit in the delegate.
     /// returns the pair [task_body, future]
     template <class Callable, class... Args>
-    [[nodiscard]] static auto make_async_task(Callable callable, Args... args)
+    [[nodiscard]] static auto make_async_task(std::allocator_arg_t, std::pmr::memory_resource* resource, Callable callable, Args... args)
         -> std::pair<xtl::delegate<void()>, std::future<std::invoke_result_t<std::decay_t<Callable>, std::decay_t<Args>...>>>
     {
         using R = std::invoke_result_t<std::decay_t<Callable>, std::decay_t<Args>...>;
@@ -31,7 +33,7 @@ namespace xtl
         // xtl::delegate supports move-only Callable and Args.
         std::promise<R> promise;
         std::future<R> future = promise.get_future();
-        xtl::delegate<void()> task = [promise = std::move(promise), callable = std::forward<Callable>(callable), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
+        xtl::delegate<void()> task(std::allocator_arg, resource, [promise = std::move(promise), callable = std::forward<Callable>(callable), args = std::make_tuple(std::forward<Args>(args)...)]() mutable
         {
             if constexpr (!std::is_same_v<R, void>)
             {
@@ -47,14 +49,24 @@ namespace xtl
                 }
                 catch (...) { promise.set_exception(std::current_exception()); }
             }
-        };
+        });
 
         return std::pair<xtl::delegate<void()>, std::future<R>>{std::move(task), std::move(future)};
     }
 
+    /// makes move-only packaged_task-like object.
+    /// returns the pair [task_body, future]
+    template <class Callable, class... Args>
+    [[nodiscard]] static auto make_async_task(Callable callable, Args... args)
+        -> std::pair<xtl::delegate<void()>, std::future<std::invoke_result_t<std::decay_t<Callable>, std::decay_t<Args>...>>>
+    {
+        return xtl::make_async_task(std::allocator_arg, std::pmr::get_default_resource(), std::move(callable), std::move(args)...);
+    }
+
     /// worker thread
     class worker_thread_pool final
     {
+        std::pmr::synchronized_pool_resource task_resource_; // for tasks which do not fit in the delegate
         std::vector<std::thread> threads_{};
         concurrent_queue<delegate<void()>> task_queue_{};
 
@@ -70,7 +82,9 @@ namespace xtl
         worker_thread_pool(
             size_t thread_count /* = 4 */,
             std::string_view label = "",
-            thread_factory_function create_thread_function = default_thread_factory_function)
+            thread_factory_function create_thread_function = default_thread_factory_function,
+            std::pmr::memory_resource* upstream_resource = std::pmr::get_default_resource())
+            : task_resource_(upstream_resource)
         {
             for (size_t i = 0; i < thread_count; i++)
             {
@@ -93,9 +107,20 @@ namespace xtl
         template <class Callable, class... Args>
         [[nodiscard]] auto async(Callable&& callable, Args&&... args) -> std::future<std::invoke_result_t<std::decay_t<Callable>, std::decay_t<Args>...>>
         {
-            auto [body, future] = xtl::make_async_task(std::forward<Callable>(callable), std::forward<Args>(args)...);
+            auto [body, future] = xtl::make_async_task(std::allocator_arg, &task_resource_, std::forward<Callable>(callable), std::forward<Args>(args)...);
             task_queue_.push(std::move(body));
             return std::move(future);
         }
+
+        /// Gets the memory resource for tasks, pooled per size-class.
+        /// Use it to construct `delegate(std::allocator_arg, resource, ...)` for `post`.
+        [[nodiscard]] std::pmr::memory_resource* task_resource() noexcept { return &task_resource_; }
+
+        /// Enqueues fire-and-forget task.
+        /// returns false if the pool is shutting down.
+        bool post(delegate<void()> task)
+        {
+            return task_queue_.push(std::move(task));
+        }
     };
 }